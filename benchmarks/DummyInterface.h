@@ -36,13 +36,12 @@
 #define MAVTOOLS_DUMMYINTERFACE_H
 
 #include "mav/Network.h"
+#include "RingBuffer.h"
 
 class DummyInterface : public mav::NetworkInterface {
 private:
-    static constexpr int MAX_RECEIVE_QUEUE_WATERMARK = 1024 * 64; // 64 KiB
-    std::string receive_queue;
-    std::mutex receive_queue_mutex;
-    mutable std::condition_variable receive_queue_cv;
+    static constexpr size_t RECEIVE_QUEUE_CAPACITY = 1024 * 64; // 64 KiB
+    SpscRingBuffer<RECEIVE_QUEUE_CAPACITY> receive_queue;
     std::string send_sponge;
     mutable std::atomic_bool should_interrupt{false};
 
@@ -50,7 +49,6 @@ public:
 
     void stop() const {
         should_interrupt.store(true);
-        receive_queue_cv.notify_all();
     }
 
     void close() override {
@@ -61,45 +59,48 @@ public:
         send_sponge.append(reinterpret_cast<const char *>(data), size);
     }
 
-    void addToReceiveQueue(const std::string &data) {
-        std::unique_lock<std::mutex> lock(receive_queue_mutex);
-        // wait, if the queue is full
-        receive_queue_cv.wait(lock, [this] {
-            return receive_queue.size() <= MAX_RECEIVE_QUEUE_WATERMARK || should_interrupt.load();
-        });
+    void addToReceiveQueue(const uint8_t *data, size_t size) {
+        Backoff backoff;
+        while (size > 0 && !should_interrupt.load(std::memory_order_relaxed)) {
+            // wait, if the queue is full
+            size_t written = receive_queue.write(data, size);
+            if (written == 0) {
+                backoff.pause();
+                continue;
+            }
+            backoff.reset();
+            data += written;
+            size -= written;
+        }
+    }
 
-        receive_queue.append(data);
-        lock.unlock();
-        receive_queue_cv.notify_all();
+    void addToReceiveQueue(const std::string &data) {
+        addToReceiveQueue(reinterpret_cast<const uint8_t *>(data.data()), data.size());
     }
 
-    void waitUntilReceiveQueueEmpty() {
-        std::unique_lock<std::mutex> lock(receive_queue_mutex);
-        if (receive_queue.empty()) {
-            return;
+    void waitUntilReceiveQueueEmpty() const {
+        Backoff backoff;
+        while (!receive_queue.empty() && !should_interrupt.load(std::memory_order_relaxed)) {
+            backoff.pause();
         }
-        receive_queue_cv.wait(lock, [this] {
-            return receive_queue.empty();
-        });
     }
 
     mav::ConnectionPartner receive(uint8_t *destination, uint32_t size) override {
-        std::unique_lock<std::mutex> lock(receive_queue_mutex);
-        if (receive_queue.size() < size) {
-            receive_queue_cv.wait(lock, [this, size] {
-                return receive_queue.size() >= size || should_interrupt.load();
-            });
+        // requests larger than the queue are filled in pieces
+        Backoff backoff;
+        while (size > 0) {
+            if (should_interrupt.load(std::memory_order_relaxed)) {
+                throw mav::NetworkInterfaceInterrupt();
+            }
+            size_t count = receive_queue.read(destination, size);
+            if (count > 0) {
+                backoff.reset();
+                destination += count;
+                size -= static_cast<uint32_t>(count);
+            } else {
+                backoff.pause();
+            }
         }
-        if (should_interrupt.load()) {
-            throw mav::NetworkInterfaceInterrupt();
-        }
-        std::copy(receive_queue.begin(), receive_queue.begin() + size, destination);
-        receive_queue.erase(0, size);
-
-        if (receive_queue.size() < MAX_RECEIVE_QUEUE_WATERMARK / 2) {
-            receive_queue_cv.notify_all();
-        }
-
         return mav::ConnectionPartner{};
     }
 };
@@ -0,0 +1,135 @@
+/****************************************************************************
+ *
+ * Copyright (c) 2024, libmav development team
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name libmav nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+#ifndef MAVTOOLS_BENCHMARKS_PROCESS_H
+#define MAVTOOLS_BENCHMARKS_PROCESS_H
+
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/**
+ * Helpers to time the mavtools executables from the benchmarks.
+ */
+namespace process {
+    using Clock = std::chrono::steady_clock;
+
+    [[noreturn]] inline void exec(const std::vector<std::string> &command) {
+        std::vector<char *> argv;
+        for (const auto &arg : command) {
+            argv.push_back(const_cast<char *>(arg.c_str()));
+        }
+        argv.push_back(nullptr);
+        // tools log their progress to stderr
+        if (!std::freopen("/dev/null", "w", stderr)) {
+            _exit(127);
+        }
+        execv(argv[0], argv.data());
+        _exit(127);
+    }
+
+    /**
+     * Runs a tool, feeds it stdin_data, and measures the time until the first byte shows up on its stdout.
+     * @return milliseconds
+     */
+    inline double timeToFirstOutput(const std::vector<std::string> &command, const std::string &stdin_data) {
+        int stdin_pipe[2];
+        int stdout_pipe[2];
+        if (pipe(stdin_pipe) != 0 || pipe(stdout_pipe) != 0) {
+            throw std::runtime_error("Could not create pipes");
+        }
+
+        auto start = Clock::now();
+        pid_t pid = fork();
+        if (pid == 0) {
+            dup2(stdin_pipe[0], STDIN_FILENO);
+            dup2(stdout_pipe[1], STDOUT_FILENO);
+            close(stdin_pipe[1]);
+            close(stdout_pipe[0]);
+            exec(command);
+        }
+        close(stdin_pipe[0]);
+        close(stdout_pipe[1]);
+
+        if (!stdin_data.empty()) {
+            ssize_t ignored = write(stdin_pipe[1], stdin_data.data(), stdin_data.size());
+            (void)ignored;
+        }
+        close(stdin_pipe[1]);
+
+        char byte;
+        ssize_t got = read(stdout_pipe[0], &byte, 1);
+        double elapsed = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+        close(stdout_pipe[0]);
+        kill(pid, SIGTERM);
+        waitpid(pid, nullptr, 0);
+        if (got != 1) {
+            throw std::runtime_error("No output from " + command[0]);
+        }
+        return elapsed;
+    }
+
+    /**
+     * Runs a tool to completion, with its stdout sent to stdout_path.
+     * @return seconds
+     */
+    inline double run(const std::vector<std::string> &command, const std::string &stdout_path = "/dev/null") {
+        auto start = Clock::now();
+        pid_t pid = fork();
+        if (pid == 0) {
+            int fd = open(stdout_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+            if (fd < 0) {
+                _exit(127);
+            }
+            dup2(fd, STDOUT_FILENO);
+            exec(command);
+        }
+        int status = 0;
+        waitpid(pid, &status, 0);
+        double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            throw std::runtime_error(command[0] + " failed");
+        }
+        return elapsed;
+    }
+}
+
+#endif //MAVTOOLS_BENCHMARKS_PROCESS_H
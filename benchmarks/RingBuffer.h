@@ -0,0 +1,156 @@
+/****************************************************************************
+ *
+ * Copyright (c) 2024, libmav development team
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name libmav nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+#ifndef MAVTOOLS_RINGBUFFER_H
+#define MAVTOOLS_RINGBUFFER_H
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <thread>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+/**
+ * Escalating wait strategy for lock-free loops: busy-spin first, then yield
+ * the time slice, and finally sleep so an idle live link does not burn a core.
+ */
+class Backoff {
+private:
+    static constexpr int SPIN_LIMIT = 64;
+    static constexpr int YIELD_LIMIT = 128;
+    int _iteration = 0;
+
+public:
+    void pause() {
+        if (_iteration < SPIN_LIMIT) {
+#if defined(__x86_64__) || defined(__i386__)
+            _mm_pause();
+#endif
+        } else if (_iteration < YIELD_LIMIT) {
+            std::this_thread::yield();
+        } else {
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+            return;
+        }
+        _iteration++;
+    }
+
+    void reset() {
+        _iteration = 0;
+    }
+};
+
+/**
+ * Fixed capacity single-producer / single-consumer byte ring buffer.
+ * Read and write positions are free-running counters, so data is never shifted,
+ * and the only synchronization between the two threads are acquire / release
+ * pairs on those counters. Waiting for data or space is left to the caller, see Backoff.
+ */
+template<size_t CAPACITY>
+class SpscRingBuffer {
+    static_assert(CAPACITY > 0 && (CAPACITY & (CAPACITY - 1)) == 0, "Capacity must be a power of two");
+
+private:
+    static constexpr size_t MASK = CAPACITY - 1;
+    static constexpr size_t CACHE_LINE_SIZE = 64;
+
+    // producer and consumer counters live on separate cache lines to avoid false sharing
+    alignas(CACHE_LINE_SIZE) std::atomic<size_t> _write_position{0};
+    alignas(CACHE_LINE_SIZE) std::atomic<size_t> _read_position{0};
+    alignas(CACHE_LINE_SIZE) std::array<uint8_t, CAPACITY> _buffer{};
+
+public:
+    static constexpr size_t capacity() {
+        return CAPACITY;
+    }
+
+    [[nodiscard]] size_t size() const {
+        return _write_position.load(std::memory_order_acquire) - _read_position.load(std::memory_order_acquire);
+    }
+
+    [[nodiscard]] bool empty() const {
+        return size() == 0;
+    }
+
+    /**
+     * Producer side. Copies as many bytes as currently fit.
+     * @return the number of bytes written
+     */
+    size_t write(const uint8_t *data, size_t size) {
+        const size_t write_position = _write_position.load(std::memory_order_relaxed);
+        const size_t read_position = _read_position.load(std::memory_order_acquire);
+        const size_t free_space = CAPACITY - (write_position - read_position);
+        const size_t count = std::min(size, free_space);
+        if (count == 0) {
+            return 0;
+        }
+
+        const size_t start = write_position & MASK;
+        const size_t first_part = std::min(count, CAPACITY - start);
+        std::memcpy(_buffer.data() + start, data, first_part);
+        std::memcpy(_buffer.data(), data + first_part, count - first_part);
+
+        _write_position.store(write_position + count, std::memory_order_release);
+        return count;
+    }
+
+    /**
+     * Consumer side. Copies out up to size bytes, as many as are available.
+     * @return the number of bytes read
+     */
+    size_t read(uint8_t *destination, size_t size) {
+        const size_t read_position = _read_position.load(std::memory_order_relaxed);
+        const size_t write_position = _write_position.load(std::memory_order_acquire);
+        size = std::min(size, write_position - read_position);
+        if (size == 0) {
+            return 0;
+        }
+
+        const size_t start = read_position & MASK;
+        const size_t first_part = std::min(size, CAPACITY - start);
+        std::memcpy(destination, _buffer.data() + start, first_part);
+        std::memcpy(destination + first_part, _buffer.data(), size - first_part);
+
+        _read_position.store(read_position + size, std::memory_order_release);
+        return size;
+    }
+};
+
+#endif //MAVTOOLS_RINGBUFFER_H
@@ -0,0 +1,212 @@
+/****************************************************************************
+ *
+ * Copyright (c) 2024, libmav development team
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name libmav nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+/**
+ * Round trip benchmark for mavencode: decodes example.bin to newline-delimited JSON, repeats it,
+ * and encodes it back with the previous DOM based encoder, the SAX encoder and the parallel encoder.
+ */
+
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+
+#include "rapidjson/document.h"
+#include "rapidjson/istreamwrapper.h"
+#include "../common/builtinMessageSet.h"
+#include "../common/Frame.h"
+#include "../mavdecode/DecodeOptions.h"
+#include "../mavencode/ParallelEncoder.h"
+#include "../mavencode/RecordParser.h"
+
+
+namespace {
+    using rapidjson_value_t = rapidjson::GenericValue<rapidjson::UTF8<char>>;
+
+    // Value conversion of the DOM based encoder, kept here as the baseline
+    double parseFloating(const rapidjson_value_t &value) {
+        if (value.IsDouble()) {
+            return value.GetDouble();
+        }
+        std::string str = value.GetString();
+        return str == "Infinity" ? INFINITY : str == "-Infinity" ? -INFINITY : NAN;
+    }
+
+    bool isFloatingPoint(const rapidjson_value_t &value) {
+        if (value.IsString()) {
+            std::string str = value.GetString();
+            return str == "NaN" || str == "Infinity" || str == "-Infinity";
+        }
+        return value.IsDouble();
+    }
+
+    mav::NativeVariantType fromGeneric(const rapidjson_value_t &generic) {
+        if (isFloatingPoint(generic)) {
+            return parseFloating(generic);
+        } else if (generic.IsInt() || generic.IsInt64()) {
+            return generic.GetInt64();
+        } else if (generic.IsUint() || generic.IsUint64()) {
+            return generic.GetUint64();
+        } else if (generic.IsString()) {
+            return std::string{generic.GetString()};
+        } else if (generic.IsArray()) {
+            auto array = generic.GetArray();
+            if (array.Empty()) {
+                return std::vector<int64_t>{};
+            } else if (isFloatingPoint(*array.begin())) {
+                std::vector<double> r;
+                for (auto &value : array) {
+                    r.emplace_back(parseFloating(value));
+                }
+                return r;
+            } else if (array.begin()->IsInt64()) {
+                std::vector<int64_t> r;
+                for (auto &value : array) {
+                    r.emplace_back(value.GetInt64());
+                }
+                return r;
+            }
+            std::vector<uint64_t> r;
+            for (auto &value : array) {
+                r.emplace_back(value.GetUint64());
+            }
+            return r;
+        }
+        throw std::runtime_error("Unknown type");
+    }
+
+    std::string encodeWithDocument(const mav::MessageSet &message_set, const std::string &json) {
+        std::istringstream input{json};
+        std::ostringstream output;
+        rapidjson::Document document;
+        rapidjson::IStreamWrapper isw{input};
+        while (true) {
+            document.ParseStream<rapidjson::kParseStopWhenDoneFlag>(isw);
+            if (document.HasParseError()) {
+                break;
+            }
+            auto message = message_set.create(document["id"].GetInt());
+            message.header().systemId() = document["system_id"].GetInt();
+            message.header().componentId() = document["component_id"].GetInt();
+            for (auto &field : document["fields"].GetObject()) {
+                std::string name = field.name.GetString();
+                if (message.type().containsField(name)) {
+                    message.setFromNativeTypeVariant(name, fromGeneric(field.value));
+                }
+            }
+            int len = message.finalize(document["seq"].GetInt(), {1, 1});
+            output.write(reinterpret_cast<const char *>(message.data()), len);
+        }
+        return output.str();
+    }
+
+    std::string decodeToJson(const mav::MessageSet &message_set, const std::string &capture) {
+        DecodeOptions options{message_set};
+        RecordFormatter formatter{options};
+        FrameScanner scanner{message_set};
+        auto data = reinterpret_cast<const uint8_t *>(capture.data());
+        std::string json;
+        FrameView frame;
+        size_t offset = 0;
+        while ((offset = scanner.find(data, offset, capture.size(), capture.size(), frame)) < capture.size()) {
+            json.append(formatter.format(RawMessage::fromFrame(frame)));
+            offset += frame.size;
+        }
+        return json;
+    }
+
+    template<typename F>
+    std::string measure(const char *label, size_t json_size, F &&encode) {
+        auto start = std::chrono::steady_clock::now();
+        std::string frames = encode();
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::cout << label << static_cast<double>(json_size) / seconds / 1e6 << " MB/s of JSON" << std::endl;
+        return frames;
+    }
+}
+
+
+int main(int argc, char *argv[]) {
+    size_t repetitions = 100;
+    if (argc > 1) {
+        repetitions = std::stoul(argv[1]);
+    }
+
+    mav::MessageSet message_set;
+    loadBuiltinMessageSet(message_set);
+
+    std::ifstream capture_file(EXAMPLE_CAPTURE, std::ios::binary);
+    std::stringstream capture;
+    capture << capture_file.rdbuf();
+    const std::string records = decodeToJson(message_set, capture.str());
+    std::string json;
+    json.reserve(records.size() * repetitions);
+    for (size_t i = 0; i < repetitions; i++) {
+        json.append(records);
+    }
+    std::cout << "Encoding " << json.size() / (1024 * 1024) << " MiB of JSON, example.bin decoded "
+              << repetitions << " times" << std::endl;
+
+    std::atomic_bool interrupted{false};
+    auto document = measure("DOM + create per record:     ", json.size(), [&] {
+        return encodeWithDocument(message_set, json);
+    });
+    auto sax = measure("SAX + message templates:     ", json.size(), [&] {
+        std::string input = json;
+        std::string output;
+        MessageBuilder builder{message_set, [&output](const uint8_t *data, size_t size, uint64_t) {
+            output.append(reinterpret_cast<const char *>(data), size);
+        }};
+        parseRecords(input.data(), input.data() + input.size(), builder, interrupted);
+        return output;
+    });
+    const int threads = static_cast<int>(std::thread::hardware_concurrency());
+    auto parallel = measure("SAX on all cores:            ", json.size(), [&] {
+        std::string input = json;
+        std::string output;
+        ParallelEncoder encoder{message_set, threads};
+        MappedBlocks blocks{input.data(), input.data() + input.size(), ParallelEncoder::BLOCK_SIZE};
+        encoder.encode(blocks, [&output](std::string_view frames) { output.append(frames); }, interrupted);
+        return output;
+    });
+
+    if (sax != document || parallel != document) {
+        std::cerr << "Encoders produced different output" << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,347 @@
+/****************************************************************************
+ *
+ * Copyright (c) 2024, libmav development team
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name libmav nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+/**
+ * Benchmark suite for regression tracking. Measures StreamParser throughput through the DummyInterface,
+ * stream scanning of clean and noisy input, JSON serialization cost per message type, end-to-end mavdecode / mavencode throughput and startup time,
+ * on example.bin and on a synthetic capture, and prints the results as one JSON document.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+#include "args/args.hxx"
+#include "DummyInterface.h"
+#include "../common/Frame.h"
+#include "../common/JsonWriter.h"
+#include "../common/StreamScanner.h"
+#include "../common/TrafficGenerator.h"
+#include "../common/builtinMessageSet.h"
+#include "../mavdecode/DecodeOptions.h"
+#include "Process.h"
+
+
+namespace {
+    using Clock = std::chrono::steady_clock;
+
+    // roughly the message mix of a multirotor streaming to a ground station
+    constexpr const char *DEFAULT_MIX = "HEARTBEAT=1,SYS_STATUS=2,ATTITUDE=50,ATTITUDE_QUATERNION=50,"
+                                        "GLOBAL_POSITION_INT=10,GPS_RAW_INT=5,HIGHRES_IMU=100,"
+                                        "SERVO_OUTPUT_RAW=10,VFR_HUD=4,STATUSTEXT=0.5";
+    constexpr int STARTUP_REPETITIONS = 10;
+
+    struct Capture {
+        std::string name;
+        std::string data;
+        size_t messages = 0;
+        // one frame per message id, to measure serialization
+        std::map<uint32_t, size_t> samples;
+        std::string path;
+    };
+
+    double secondsSince(Clock::time_point start) {
+        return std::chrono::duration<double>(Clock::now() - start).count();
+    }
+
+    void scanCapture(const mav::MessageSet &message_set, Capture &capture) {
+        FrameScanner scanner{message_set};
+        auto data = reinterpret_cast<const uint8_t *>(capture.data.data());
+        const size_t size = capture.data.size();
+        FrameView frame;
+        size_t offset = 0;
+        while ((offset = scanner.find(data, offset, size, size, frame)) < size) {
+            capture.messages++;
+            capture.samples.emplace(frame.message_id, offset);
+            offset += frame.size;
+        }
+    }
+
+    std::string writeTemporary(const std::string &name, const std::string &data) {
+        std::string path = "/tmp/mavbench-" + std::to_string(::getpid()) + "-" + name;
+        std::ofstream file(path, std::ios::binary);
+        file.write(data.data(), static_cast<std::streamsize>(data.size()));
+        return path;
+    }
+
+    void writeThroughput(JsonWriter &json, const Capture &capture, double seconds) {
+        json.raw("{\"seconds\": ").number(seconds);
+        json.raw(", \"bytes_per_second\": ").number(static_cast<double>(capture.data.size()) / seconds);
+        json.raw(", \"messages_per_second\": ").number(static_cast<double>(capture.messages) / seconds);
+        json.raw('}');
+    }
+
+    /**
+     * The former stdin path of mavdecode, kept as a baseline: 64 byte reads into the DummyInterface, and a StreamParser thread.
+     */
+    double measureStreamParser(const mav::MessageSet &message_set, const Capture &capture) {
+        DummyInterface interface;
+        mav::StreamParser stream_parser{message_set, interface};
+        size_t parsed = 0;
+
+        auto start = Clock::now();
+        std::thread consumer([&stream_parser, &parsed] {
+            try {
+                while (true) {
+                    stream_parser.next();
+                    parsed++;
+                }
+            } catch (mav::NetworkInterfaceInterrupt &) {
+            }
+        });
+        auto data = reinterpret_cast<const uint8_t *>(capture.data.data());
+        for (size_t offset = 0; offset < capture.data.size(); offset += 64) {
+            interface.addToReceiveQueue(data + offset, std::min<size_t>(64, capture.data.size() - offset));
+        }
+        interface.waitUntilReceiveQueueEmpty();
+        interface.stop();
+        consumer.join();
+        double seconds = secondsSince(start);
+        if (parsed != capture.messages) {
+            std::cerr << "StreamParser returned " << parsed << " of " << capture.messages << " messages" << std::endl;
+        }
+        return seconds;
+    }
+
+    /**
+     * Frames the data in one block, like the stream inputs of mavdecode do.
+     */
+    void measureScan(JsonWriter &json, const mav::MessageSet &message_set, const std::string &data) {
+        FrameScanner scanner{message_set};
+        bool in_sync = false;
+        uint64_t discarded = 0;
+        size_t frames = 0;
+        auto start = Clock::now();
+        StreamScanner::scanBlock(scanner, reinterpret_cast<const uint8_t *>(data.data()), data.size(), in_sync,
+                                 discarded, [&frames](const FrameView &) { frames++; }, [](const FrameView &) {});
+        const double seconds = secondsSince(start);
+        json.raw("{\"seconds\": ").number(seconds);
+        json.raw(", \"bytes_per_second\": ").number(static_cast<double>(data.size()) / seconds);
+        json.raw(", \"frames\": ").number(frames);
+        json.raw(", \"discarded_bytes\": ").number(discarded);
+        json.raw('}');
+    }
+
+    /**
+     * @return the capture with as much random noise, in alternating 4 KiB pieces, like a bad radio link
+     */
+    std::string addNoise(const std::string &data) {
+        constexpr size_t PIECE_SIZE = 4096;
+        std::mt19937 random{1};
+        std::string noisy;
+        noisy.reserve(data.size() * 2);
+        for (size_t offset = 0; offset < data.size(); offset += PIECE_SIZE) {
+            noisy.append(data, offset, PIECE_SIZE);
+            for (size_t i = 0; i < PIECE_SIZE; i++) {
+                noisy.push_back(static_cast<char>(random()));
+            }
+        }
+        return noisy;
+    }
+
+    /**
+     * @return nanoseconds to turn one message of each type into a JSON record
+     */
+    std::map<uint32_t, double> measureSerialization(const mav::MessageSet &message_set,
+                                                    const std::vector<Capture> &captures) {
+        DecodeOptions options{message_set};
+        RecordFormatter formatter{options};
+        FrameScanner scanner{message_set};
+        std::map<uint32_t, double> result;
+        for (const auto &capture : captures) {
+            auto data = reinterpret_cast<const uint8_t *>(capture.data.data());
+            for (const auto &[message_id, offset] : capture.samples) {
+                if (result.count(message_id)) {
+                    continue;
+                }
+                FrameView frame;
+                scanner.find(data, offset, offset + 1, capture.data.size(), frame);
+                const RawMessage message = RawMessage::fromFrame(frame);
+                size_t iterations = 0;
+                auto start = Clock::now();
+                // run for at least 20 ms per type
+                while (iterations < 1000 || secondsSince(start) < 0.02) {
+                    for (int i = 0; i < 100; i++) {
+                        formatter.format(message);
+                    }
+                    iterations += 100;
+                }
+                result[message_id] = secondsSince(start) * 1e9 / static_cast<double>(iterations);
+            }
+        }
+        return result;
+    }
+
+    template<typename F>
+    double medianMilliseconds(F &&f) {
+        std::vector<double> samples;
+        for (int i = 0; i < STARTUP_REPETITIONS; i++) {
+            samples.push_back(f());
+        }
+        std::sort(samples.begin(), samples.end());
+        return samples[samples.size() / 2];
+    }
+}
+
+
+int main(int argc, char *argv[]) {
+    args::ArgumentParser parser("mavtools benchmark suite, prints its results as JSON");
+    args::HelpFlag help(parser, "help", "Display this help menu", {'h', "help"});
+    args::ValueFlag<size_t> size(parser, "MiB", "Size of the synthetic capture", {"size"}, 64);
+    args::ValueFlag<std::string> mix(parser, "profile", "Message mix of the synthetic capture, as NAME=Hz[@sysid:compid] entries", {"mix"}, DEFAULT_MIX);
+    args::ValueFlag<uint64_t> seed(parser, "seed", "Seed for the synthetic field values", {"seed"}, 1);
+    args::ValueFlag<size_t> repeat(parser, "count", "How many times example.bin is repeated for the throughput measurements", {"repeat"}, 20);
+    args::ValueFlag<std::string> output_file(parser, "file", "Write the results to a file instead of stdout", {'o', "output"});
+
+    try {
+        parser.ParseCLI(argc, argv);
+    } catch (args::Help &) {
+        std::cout << parser;
+        return 0;
+    } catch (args::ParseError &e) {
+        std::cerr << e.what() << std::endl;
+        std::cerr << parser;
+        return 1;
+    }
+
+    mav::MessageSet message_set;
+    loadBuiltinMessageSet(message_set);
+
+    std::vector<Capture> captures(2);
+    {
+        std::ifstream file(EXAMPLE_CAPTURE, std::ios::binary);
+        std::stringstream ss;
+        ss << file.rdbuf();
+        captures[0].name = "example.bin";
+        for (size_t i = 0; i < args::get(repeat); i++) {
+            captures[0].data.append(ss.str());
+        }
+    }
+    try {
+        TrafficGenerator generator{message_set, parseTrafficProfile(args::get(mix), message_set), args::get(seed)};
+        captures[1].name = "synthetic";
+        const size_t synthetic_size = args::get(size) * 1024 * 1024;
+        captures[1].data.reserve(synthetic_size + 300);
+        while (captures[1].data.size() < synthetic_size) {
+            generator.next(captures[1].data);
+        }
+    } catch (std::invalid_argument &e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+
+    JsonWriter json;
+    json.raw("{\"config\": {\"synthetic_bytes\": ").number(captures[1].data.size());
+    json.raw(", \"mix\": ").string(args::get(mix));
+    json.raw(", \"seed\": ").number(args::get(seed));
+    json.raw(", \"example_repeat\": ").number(args::get(repeat));
+    json.raw(", \"threads\": ").number(std::thread::hardware_concurrency());
+    json.raw("}, \"inputs\": [");
+    for (auto &capture : captures) {
+        std::cerr << "Measuring " << capture.name << std::endl;
+        scanCapture(message_set, capture);
+        capture.path = writeTemporary(capture.name, capture.data);
+        const std::string json_path = capture.path + ".json";
+
+        json.raw(&capture == &captures.front() ? "{" : ", {");
+        json.raw("\"name\": ").string(capture.name);
+        json.raw(", \"bytes\": ").number(capture.data.size());
+        json.raw(", \"messages\": ").number(capture.messages);
+        json.raw(", \"stream_parser\": ");
+        writeThroughput(json, capture, measureStreamParser(message_set, capture));
+        json.raw(", \"scan\": ");
+        measureScan(json, message_set, capture.data);
+        json.raw(", \"scan_noisy\": ");
+        measureScan(json, message_set, addNoise(capture.data));
+        json.raw(", \"mavdecode\": ");
+        writeThroughput(json, capture, process::run({MAVDECODE_EXECUTABLE, capture.path}, json_path));
+        json.raw(", \"mavdecode_stdin\": ");
+        writeThroughput(json, capture, process::run({"/bin/sh", "-c", std::string{MAVDECODE_EXECUTABLE} + " < " + capture.path}));
+        json.raw(", \"mavencode\": ");
+        writeThroughput(json, capture, process::run({MAVENCODE_EXECUTABLE, json_path, "-o", "/dev/null"}));
+        json.raw('}');
+        ::unlink(json_path.c_str());
+    }
+
+    std::cerr << "Measuring JSON serialization" << std::endl;
+    json.raw("], \"serialization_ns_per_message\": [");
+    bool first = true;
+    for (const auto &[message_id, nanoseconds] : measureSerialization(message_set, captures)) {
+        json.raw(first ? "{" : ", {");
+        first = false;
+        json.raw("\"id\": ").number(message_id);
+        json.raw(", \"name\": ").string(message_set.getMessageDefinition(static_cast<int>(message_id)).get().name());
+        json.raw(", \"ns\": ").number(nanoseconds);
+        json.raw('}');
+    }
+
+    std::cerr << "Measuring startup" << std::endl;
+    const std::string xml = std::string{MAVLINK_DEFINITIONS_DIR} + "/development.xml";
+    const std::string heartbeat = R"({"id": 0, "system_id": 1, "component_id": 1, "seq": 0, "fields": {}})" "\n";
+    const std::string &example = captures[0].path;
+    json.raw("], \"startup_ms\": {\"mavdecode_builtin\": ").number(medianMilliseconds([&] {
+        return process::timeToFirstOutput({MAVDECODE_EXECUTABLE, example, "--flush=message"}, "");
+    }));
+    json.raw(", \"mavdecode_xml\": ").number(medianMilliseconds([&] {
+        return process::timeToFirstOutput({MAVDECODE_EXECUTABLE, example, "--flush=message", "--xml", xml}, "");
+    }));
+    json.raw(", \"mavencode_builtin\": ").number(medianMilliseconds([&] {
+        return process::timeToFirstOutput({MAVENCODE_EXECUTABLE, "--flush=message"}, heartbeat);
+    }));
+    json.raw(", \"mavencode_xml\": ").number(medianMilliseconds([&] {
+        return process::timeToFirstOutput({MAVENCODE_EXECUTABLE, "--flush=message", "--xml", xml}, heartbeat);
+    }));
+    json.raw("}}\n");
+
+    for (const auto &capture : captures) {
+        ::unlink(capture.path.c_str());
+    }
+
+    if (output_file) {
+        std::ofstream file(args::get(output_file));
+        file << json.view();
+    } else {
+        std::cout << json.view();
+    }
+    return 0;
+}
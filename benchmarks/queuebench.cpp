@@ -0,0 +1,159 @@
+/****************************************************************************
+ *
+ * Copyright (c) 2024, libmav development team
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name libmav nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+/**
+ * Microbenchmark for the receive queue between the input reader and the StreamParser thread.
+ * Compares the previous mutex / std::string queue against the lock-free ring buffer in
+ * DummyInterface, using the read pattern of the StreamParser (magic byte, header, payload + crc).
+ */
+
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "DummyInterface.h"
+
+
+namespace {
+    // Receive queue as it was before the ring buffer, kept here as the baseline
+    class LegacyDummyInterface : public mav::NetworkInterface {
+    private:
+        static constexpr int MAX_RECEIVE_QUEUE_WATERMARK = 1024 * 64; // 64 KiB
+        std::string receive_queue;
+        std::mutex receive_queue_mutex;
+        mutable std::condition_variable receive_queue_cv;
+        mutable std::atomic_bool should_interrupt{false};
+
+    public:
+        void stop() const {
+            should_interrupt.store(true);
+            receive_queue_cv.notify_all();
+        }
+
+        void close() override {
+            stop();
+        }
+
+        void send(const uint8_t *, uint32_t, mav::ConnectionPartner) override {}
+
+        void addToReceiveQueue(const uint8_t *data, size_t size) {
+            std::unique_lock<std::mutex> lock(receive_queue_mutex);
+            receive_queue_cv.wait(lock, [this] {
+                return receive_queue.size() <= MAX_RECEIVE_QUEUE_WATERMARK || should_interrupt.load();
+            });
+            receive_queue.append(std::string(reinterpret_cast<const char *>(data), size));
+            lock.unlock();
+            receive_queue_cv.notify_all();
+        }
+
+        void waitUntilReceiveQueueEmpty() {
+            std::unique_lock<std::mutex> lock(receive_queue_mutex);
+            receive_queue_cv.wait(lock, [this] {
+                return receive_queue.empty();
+            });
+        }
+
+        mav::ConnectionPartner receive(uint8_t *destination, uint32_t size) override {
+            std::unique_lock<std::mutex> lock(receive_queue_mutex);
+            if (receive_queue.size() < size) {
+                receive_queue_cv.wait(lock, [this, size] {
+                    return receive_queue.size() >= size || should_interrupt.load();
+                });
+            }
+            if (should_interrupt.load()) {
+                throw mav::NetworkInterfaceInterrupt();
+            }
+            std::copy(receive_queue.begin(), receive_queue.begin() + size, destination);
+            receive_queue.erase(0, size);
+            if (receive_queue.size() < MAX_RECEIVE_QUEUE_WATERMARK / 2) {
+                receive_queue_cv.notify_all();
+            }
+            return mav::ConnectionPartner{};
+        }
+    };
+
+    // StreamParser style reads: magic byte, rest of a v2 header, payload + crc of a typical message
+    constexpr uint32_t READ_PATTERN[] = {1, 9, 30};
+    constexpr size_t READ_PATTERN_BYTES = 1 + 9 + 30;
+    // mavdecode reads its input in chunks of this size
+    constexpr size_t PRODUCER_CHUNK_SIZE = 64;
+
+    template<typename Interface>
+    double measureBytesPerSecond(size_t total_bytes) {
+        Interface interface;
+        std::vector<uint8_t> chunk(PRODUCER_CHUNK_SIZE, 0x55);
+        const size_t rounds = total_bytes / READ_PATTERN_BYTES;
+        const size_t bytes = rounds * READ_PATTERN_BYTES;
+
+        auto start = std::chrono::steady_clock::now();
+        std::thread consumer([&interface, rounds] {
+            uint8_t destination[256];
+            for (size_t i = 0; i < rounds; i++) {
+                for (uint32_t size : READ_PATTERN) {
+                    interface.receive(destination, size);
+                }
+            }
+        });
+
+        size_t produced = 0;
+        while (produced < bytes) {
+            size_t size = std::min(PRODUCER_CHUNK_SIZE, bytes - produced);
+            interface.addToReceiveQueue(chunk.data(), size);
+            produced += size;
+        }
+        consumer.join();
+        auto end = std::chrono::steady_clock::now();
+
+        return static_cast<double>(bytes) / std::chrono::duration<double>(end - start).count();
+    }
+}
+
+
+int main(int argc, char *argv[]) {
+    size_t megabytes = 256;
+    if (argc > 1) {
+        megabytes = std::stoul(argv[1]);
+    }
+    const size_t total_bytes = megabytes * 1024 * 1024;
+
+    std::cout << "Transferring " << megabytes << " MiB through each receive queue" << std::endl;
+    double legacy = measureBytesPerSecond<LegacyDummyInterface>(total_bytes);
+    std::cout << "mutex + std::string queue: " << legacy / 1e6 << " MB/s" << std::endl;
+    double ring = measureBytesPerSecond<DummyInterface>(total_bytes);
+    std::cout << "spsc ring buffer queue:    " << ring / 1e6 << " MB/s" << std::endl;
+    std::cout << "speedup: " << ring / legacy << "x" << std::endl;
+    return 0;
+}
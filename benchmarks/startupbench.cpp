@@ -0,0 +1,114 @@
+/****************************************************************************
+ *
+ * Copyright (c) 2024, libmav development team
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name libmav nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+/**
+ * Startup benchmark: time to load the built-in message set from the embedded minified XMLs versus
+ * the full dialect XMLs, and time-to-first-message of the mavdecode and mavencode executables.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "../common/builtinMessageSet.h"
+#include "Process.h"
+
+
+namespace {
+    using Clock = std::chrono::steady_clock;
+
+    constexpr int REPETITIONS = 20;
+
+    std::string readFile(const std::string &path) {
+        std::ifstream file(path, std::ios::binary);
+        std::stringstream ss;
+        ss << file.rdbuf();
+        return ss.str();
+    }
+
+    template<typename F>
+    double medianMilliseconds(F &&f) {
+        std::vector<double> samples;
+        for (int i = 0; i < REPETITIONS; i++) {
+            samples.push_back(f());
+        }
+        std::sort(samples.begin(), samples.end());
+        return samples[samples.size() / 2];
+    }
+
+    double millisecondsSince(Clock::time_point start) {
+        return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    }
+}
+
+
+int main() {
+    const std::string dialects[] = {"minimal.xml", "standard.xml", "common.xml", "development.xml"};
+    std::vector<std::string> full_xml;
+    for (const auto &dialect : dialects) {
+        full_xml.push_back(readFile(std::string{MAVLINK_DEFINITIONS_DIR} + "/" + dialect));
+    }
+
+    double full = medianMilliseconds([&full_xml] {
+        auto start = Clock::now();
+        mav::MessageSet message_set;
+        for (const auto &xml : full_xml) {
+            message_set.addFromXMLString(xml);
+        }
+        return millisecondsSince(start);
+    });
+    double embedded = medianMilliseconds([] {
+        auto start = Clock::now();
+        mav::MessageSet message_set;
+        loadBuiltinMessageSet(message_set);
+        return millisecondsSince(start);
+    });
+    std::cout << "message set from full dialect XML: " << full << " ms" << std::endl;
+    std::cout << "message set from embedded minified XML: " << embedded << " ms" << std::endl;
+
+    double decode = medianMilliseconds([] {
+        return process::timeToFirstOutput({MAVDECODE_EXECUTABLE, EXAMPLE_CAPTURE, "--flush=message"}, "");
+    });
+    const std::string heartbeat = R"({"id": 0, "name": "HEARTBEAT", "system_id": 1, "component_id": 1, "seq": 0, "fields": {}})";
+    double encode = medianMilliseconds([&heartbeat] {
+        return process::timeToFirstOutput({MAVENCODE_EXECUTABLE}, heartbeat + "\n");
+    });
+    std::cout << "mavdecode time to first message: " << decode << " ms" << std::endl;
+    std::cout << "mavencode time to first message: " << encode << " ms" << std::endl;
+    return 0;
+}
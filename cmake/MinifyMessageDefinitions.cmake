@@ -0,0 +1,21 @@
+# Strips a MAVLink message definition XML down to what the message set parser needs,
+# so the built-in message set parses at startup without wading through documentation.
+#
+# Usage: cmake -DINPUT=<dialect.xml> -DOUTPUT=<minified.xml> -P MinifyMessageDefinitions.cmake
+
+if(NOT INPUT OR NOT OUTPUT)
+    message(FATAL_ERROR "INPUT and OUTPUT must be set")
+endif()
+
+file(READ "${INPUT}" xml)
+
+# comments
+string(REGEX REPLACE "<!--([^-]|-[^-])*-->" "" xml "${xml}")
+# documentation, which is most of the size of the dialects
+string(REGEX REPLACE "<description>[^<]*</description>" "" xml "${xml}")
+string(REGEX REPLACE "<description/>" "" xml "${xml}")
+string(REGEX REPLACE "(<field [^>]*>)[^<]*</field>" "\\1</field>" xml "${xml}")
+# indentation and line breaks between elements
+string(REGEX REPLACE ">[ \t\r\n]+<" "><" xml "${xml}")
+
+file(WRITE "${OUTPUT}" "${xml}")
@@ -0,0 +1,327 @@
+/****************************************************************************
+ *
+ * Copyright (c) 2024, libmav development team
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name libmav nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+#ifndef MAVTOOLS_BINARYWRITER_H
+#define MAVTOOLS_BINARYWRITER_H
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+#include "MessagePlan.h"
+
+/**
+ * Element type codes of typed arrays, as in the little endian typed array tags of RFC 8746 minus 64.
+ * CBOR writes them as tags 64 + code, MessagePack as the extension type.
+ */
+namespace TypedArrayCode {
+    constexpr uint8_t UINT8 = 0;
+    constexpr uint8_t UINT16 = 5;
+    constexpr uint8_t UINT32 = 6;
+    constexpr uint8_t UINT64 = 7;
+    constexpr uint8_t INT8 = 8;
+    constexpr uint8_t INT16 = 13;
+    constexpr uint8_t INT32 = 14;
+    constexpr uint8_t INT64 = 15;
+    constexpr uint8_t FLOAT = 21;
+    constexpr uint8_t DOUBLE = 22;
+
+    template<typename T>
+    constexpr uint8_t of() {
+        if constexpr (std::is_same_v<T, float>) {
+            return FLOAT;
+        } else if constexpr (std::is_same_v<T, double>) {
+            return DOUBLE;
+        } else if constexpr (std::is_signed_v<T>) {
+            return sizeof(T) == 1 ? INT8 : sizeof(T) == 2 ? INT16 : sizeof(T) == 4 ? INT32 : INT64;
+        } else {
+            return sizeof(T) == 1 ? UINT8 : sizeof(T) == 2 ? UINT16 : sizeof(T) == 4 ? UINT32 : UINT64;
+        }
+    }
+
+    /**
+     * Calls f(TypeTag<T>{}) with the element type of a code.
+     * @return false for codes that are not supported, e.g. big endian arrays
+     */
+    template<typename F>
+    bool dispatch(uint8_t code, F &&f) {
+        switch (code) {
+            case UINT8: f(TypeTag<uint8_t>{}); return true;
+            case UINT16: f(TypeTag<uint16_t>{}); return true;
+            case UINT32: f(TypeTag<uint32_t>{}); return true;
+            case UINT64: f(TypeTag<uint64_t>{}); return true;
+            case INT8: f(TypeTag<int8_t>{}); return true;
+            case INT16: f(TypeTag<int16_t>{}); return true;
+            case INT32: f(TypeTag<int32_t>{}); return true;
+            case INT64: f(TypeTag<int64_t>{}); return true;
+            case FLOAT: f(TypeTag<float>{}); return true;
+            case DOUBLE: f(TypeTag<double>{}); return true;
+            default: return false;
+        }
+    }
+}
+
+/**
+ * Common buffer handling of the binary writers. Multi-byte heads and values are big endian in both formats.
+ */
+class BinaryWriter {
+protected:
+    std::string _buffer;
+
+    void _byte(uint8_t value) {
+        _buffer.push_back(static_cast<char>(value));
+    }
+
+    template<typename T>
+    void _bigEndian(T value) {
+        char bytes[sizeof(T)];
+        for (size_t i = 0; i < sizeof(T); i++) {
+            bytes[i] = static_cast<char>(value >> (8 * (sizeof(T) - 1 - i)));
+        }
+        _buffer.append(bytes, sizeof(T));
+    }
+
+    template<typename T>
+    void _bigEndianFloat(T value) {
+        using Bits = std::conditional_t<sizeof(T) == 4, uint32_t, uint64_t>;
+        Bits bits;
+        std::memcpy(&bits, &value, sizeof(T));
+        _bigEndian(bits);
+    }
+
+public:
+    BinaryWriter() {
+        _buffer.reserve(4096);
+    }
+
+    void clear() {
+        _buffer.clear();
+    }
+
+    [[nodiscard]] std::string_view view() const {
+        return _buffer;
+    }
+};
+
+/**
+ * Appends CBOR (RFC 8949) items to a reusable buffer.
+ */
+class CborWriter : public BinaryWriter {
+private:
+    void _head(uint8_t major, uint64_t value) {
+        major <<= 5;
+        if (value < 24) {
+            _byte(major | static_cast<uint8_t>(value));
+        } else if (value <= 0xFF) {
+            _byte(major | 24);
+            _byte(static_cast<uint8_t>(value));
+        } else if (value <= 0xFFFF) {
+            _byte(major | 25);
+            _bigEndian(static_cast<uint16_t>(value));
+        } else if (value <= 0xFFFFFFFF) {
+            _byte(major | 26);
+            _bigEndian(static_cast<uint32_t>(value));
+        } else {
+            _byte(major | 27);
+            _bigEndian(value);
+        }
+    }
+
+public:
+    CborWriter &map(size_t size) {
+        _head(5, size);
+        return *this;
+    }
+
+    CborWriter &text(std::string_view text) {
+        _head(3, text.size());
+        _buffer.append(text);
+        return *this;
+    }
+
+    template<typename T>
+    CborWriter &number(T value) {
+        if constexpr (std::is_same_v<T, float>) {
+            _byte(0xFA);
+            _bigEndianFloat(value);
+        } else if constexpr (std::is_same_v<T, double>) {
+            _byte(0xFB);
+            _bigEndianFloat(value);
+        } else if constexpr (std::is_signed_v<T>) {
+            if (value < 0) {
+                _head(1, static_cast<uint64_t>(-1 - static_cast<int64_t>(value)));
+            } else {
+                _head(0, static_cast<uint64_t>(value));
+            }
+        } else {
+            _head(0, static_cast<uint64_t>(value));
+        }
+        return *this;
+    }
+
+    /**
+     * A typed array of count little endian elements, copied as they are.
+     */
+    template<typename T>
+    CborWriter &typedArray(const uint8_t *data, size_t count) {
+        _head(6, 64 + TypedArrayCode::of<T>());
+        _head(2, count * sizeof(T));
+        _buffer.append(reinterpret_cast<const char *>(data), count * sizeof(T));
+        return *this;
+    }
+};
+
+/**
+ * Appends MessagePack items to a reusable buffer.
+ */
+class MsgPackWriter : public BinaryWriter {
+private:
+    void _unsigned(uint64_t value) {
+        if (value <= 0x7F) {
+            _byte(static_cast<uint8_t>(value));
+        } else if (value <= 0xFF) {
+            _byte(0xCC);
+            _byte(static_cast<uint8_t>(value));
+        } else if (value <= 0xFFFF) {
+            _byte(0xCD);
+            _bigEndian(static_cast<uint16_t>(value));
+        } else if (value <= 0xFFFFFFFF) {
+            _byte(0xCE);
+            _bigEndian(static_cast<uint32_t>(value));
+        } else {
+            _byte(0xCF);
+            _bigEndian(value);
+        }
+    }
+
+    void _signed(int64_t value) {
+        if (value >= 0) {
+            _unsigned(static_cast<uint64_t>(value));
+        } else if (value >= -32) {
+            _byte(static_cast<uint8_t>(value));
+        } else if (value >= INT8_MIN) {
+            _byte(0xD0);
+            _byte(static_cast<uint8_t>(value));
+        } else if (value >= INT16_MIN) {
+            _byte(0xD1);
+            _bigEndian(static_cast<uint16_t>(value));
+        } else if (value >= INT32_MIN) {
+            _byte(0xD2);
+            _bigEndian(static_cast<uint32_t>(value));
+        } else {
+            _byte(0xD3);
+            _bigEndian(static_cast<uint64_t>(value));
+        }
+    }
+
+public:
+    MsgPackWriter &map(size_t size) {
+        if (size < 16) {
+            _byte(0x80 | static_cast<uint8_t>(size));
+        } else if (size <= 0xFFFF) {
+            _byte(0xDE);
+            _bigEndian(static_cast<uint16_t>(size));
+        } else {
+            _byte(0xDF);
+            _bigEndian(static_cast<uint32_t>(size));
+        }
+        return *this;
+    }
+
+    MsgPackWriter &text(std::string_view text) {
+        if (text.size() < 32) {
+            _byte(0xA0 | static_cast<uint8_t>(text.size()));
+        } else if (text.size() <= 0xFF) {
+            _byte(0xD9);
+            _byte(static_cast<uint8_t>(text.size()));
+        } else if (text.size() <= 0xFFFF) {
+            _byte(0xDA);
+            _bigEndian(static_cast<uint16_t>(text.size()));
+        } else {
+            _byte(0xDB);
+            _bigEndian(static_cast<uint32_t>(text.size()));
+        }
+        _buffer.append(text);
+        return *this;
+    }
+
+    template<typename T>
+    MsgPackWriter &number(T value) {
+        if constexpr (std::is_same_v<T, float>) {
+            _byte(0xCA);
+            _bigEndianFloat(value);
+        } else if constexpr (std::is_same_v<T, double>) {
+            _byte(0xCB);
+            _bigEndianFloat(value);
+        } else if constexpr (std::is_signed_v<T>) {
+            _signed(static_cast<int64_t>(value));
+        } else {
+            _unsigned(static_cast<uint64_t>(value));
+        }
+        return *this;
+    }
+
+    /**
+     * A typed array of count little endian elements as an extension value, with the element type code as its type.
+     */
+    template<typename T>
+    MsgPackWriter &typedArray(const uint8_t *data, size_t count) {
+        const size_t size = count * sizeof(T);
+        switch (size) {
+            case 1: _byte(0xD4); break;
+            case 2: _byte(0xD5); break;
+            case 4: _byte(0xD6); break;
+            case 8: _byte(0xD7); break;
+            case 16: _byte(0xD8); break;
+            default:
+                if (size <= 0xFF) {
+                    _byte(0xC7);
+                    _byte(static_cast<uint8_t>(size));
+                } else if (size <= 0xFFFF) {
+                    _byte(0xC8);
+                    _bigEndian(static_cast<uint16_t>(size));
+                } else {
+                    _byte(0xC9);
+                    _bigEndian(static_cast<uint32_t>(size));
+                }
+        }
+        _byte(TypedArrayCode::of<T>());
+        _buffer.append(reinterpret_cast<const char *>(data), size);
+        return *this;
+    }
+};
+
+#endif //MAVTOOLS_BINARYWRITER_H
@@ -0,0 +1,328 @@
+/****************************************************************************
+ *
+ * Copyright (c) 2024, libmav development team
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name libmav nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+#ifndef MAVTOOLS_FRAME_H
+#define MAVTOOLS_FRAME_H
+
+#include <cstdint>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+#include "mav/MessageSet.h"
+
+static constexpr uint8_t MAVLINK_MAGIC_V1 = 0xFE;
+static constexpr uint8_t MAVLINK_MAGIC_V2 = 0xFD;
+static constexpr size_t MAVLINK_HEADER_SIZE_V1 = 6;
+static constexpr size_t MAVLINK_HEADER_SIZE_V2 = 10;
+static constexpr size_t MAVLINK_CHECKSUM_SIZE = 2;
+static constexpr size_t MAVLINK_SIGNATURE_SIZE = 13;
+static constexpr uint8_t MAVLINK_IFLAG_SIGNED = 0x01;
+
+/**
+ * Lookup tables for the MAVLink (X.25) checksum, so the checksum can be computed four bytes per step.
+ * slices[k][b] is the checksum update for byte b followed by k zero bytes.
+ */
+struct CrcTables {
+    uint16_t slices[4][256]{};
+
+    constexpr CrcTables() {
+        for (int byte = 0; byte < 256; byte++) {
+            uint16_t crc = static_cast<uint16_t>(byte);
+            for (int bit = 0; bit < 8; bit++) {
+                crc = (crc & 1) ? static_cast<uint16_t>((crc >> 1) ^ 0x8408) : static_cast<uint16_t>(crc >> 1);
+            }
+            slices[0][byte] = crc;
+        }
+        for (int k = 1; k < 4; k++) {
+            for (int byte = 0; byte < 256; byte++) {
+                const uint16_t previous = slices[k - 1][byte];
+                slices[k][byte] = static_cast<uint16_t>((previous >> 8) ^ slices[0][previous & 0xFF]);
+            }
+        }
+    }
+};
+
+inline constexpr CrcTables CRC_TABLES{};
+
+/**
+ * Searches for the next MAVLink magic byte, 16 or 32 bytes at a time where the CPU supports it.
+ * AVX2 is chosen at runtime, SSE2 is part of every x86-64 CPU, other architectures use the scalar loop.
+ */
+namespace magic_search {
+    using Function = size_t (*)(const uint8_t *data, size_t from, size_t end);
+
+    inline size_t scalar(const uint8_t *data, size_t from, size_t end) {
+        while (from < end && static_cast<uint8_t>(data[from] - MAVLINK_MAGIC_V2) > 1) {
+            from++;
+        }
+        return from;
+    }
+
+#if defined(__x86_64__) || defined(__i386__)
+    __attribute__((target("sse2")))
+    inline size_t sse2(const uint8_t *data, size_t from, size_t end) {
+        const __m128i v1 = _mm_set1_epi8(static_cast<char>(MAVLINK_MAGIC_V1));
+        const __m128i v2 = _mm_set1_epi8(static_cast<char>(MAVLINK_MAGIC_V2));
+        for (; from + 16 <= end; from += 16) {
+            const __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + from));
+            const int mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(block, v1), _mm_cmpeq_epi8(block, v2)));
+            if (mask != 0) {
+                return from + static_cast<size_t>(__builtin_ctz(static_cast<unsigned>(mask)));
+            }
+        }
+        return scalar(data, from, end);
+    }
+
+    __attribute__((target("avx2")))
+    inline size_t avx2(const uint8_t *data, size_t from, size_t end) {
+        const __m256i v1 = _mm256_set1_epi8(static_cast<char>(MAVLINK_MAGIC_V1));
+        const __m256i v2 = _mm256_set1_epi8(static_cast<char>(MAVLINK_MAGIC_V2));
+        for (; from + 32 <= end; from += 32) {
+            const __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + from));
+            const auto mask = static_cast<unsigned>(_mm256_movemask_epi8(
+                    _mm256_or_si256(_mm256_cmpeq_epi8(block, v1), _mm256_cmpeq_epi8(block, v2))));
+            if (mask != 0) {
+                return from + static_cast<size_t>(__builtin_ctz(mask));
+            }
+        }
+        return sse2(data, from, end);
+    }
+
+    inline Function select() {
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2")) {
+            return avx2;
+        }
+        return __builtin_cpu_supports("sse2") ? sse2 : scalar;
+    }
+#else
+    inline Function select() {
+        return scalar;
+    }
+#endif
+}
+
+/**
+ * @return the offset of the first magic byte in [from, end), or end if there is none
+ */
+inline size_t findMagic(const uint8_t *data, size_t from, size_t end) {
+    static const magic_search::Function search = magic_search::select();
+    return search(data, from, end);
+}
+
+/**
+ * Header level view onto a complete, raw MAVLink v1 or v2 frame.
+ */
+struct FrameView {
+    const uint8_t *data = nullptr;  // points at the magic byte
+    uint32_t size = 0;              // header, payload, checksum and signature
+    uint32_t message_id = 0;
+    uint8_t payload_length = 0;
+    uint8_t seq = 0;
+    uint8_t system_id = 0;
+    uint8_t component_id = 0;
+    bool is_v2 = false;
+    bool is_signed = false;
+
+    [[nodiscard]] size_t headerSize() const {
+        return is_v2 ? MAVLINK_HEADER_SIZE_V2 : MAVLINK_HEADER_SIZE_V1;
+    }
+
+    [[nodiscard]] const uint8_t *payload() const {
+        return data + headerSize();
+    }
+};
+
+/**
+ * Finds and validates MAVLink frames in raw memory, using only the header,
+ * the CRC and the crc_extra byte of the message definition.
+ */
+class FrameScanner {
+public:
+    enum class Status {
+        VALID,
+        INCOMPLETE,         // the frame extends past the available data
+        NO_MAGIC,
+        UNKNOWN_MESSAGE,    // no definition, so the checksum can not be verified
+        BAD_LENGTH,         // longer than any payload of the message
+        BAD_CRC
+    };
+
+private:
+    static constexpr int16_t CRC_EXTRA_UNRESOLVED = -2;
+    static constexpr int16_t CRC_EXTRA_UNKNOWN = -1;
+    // message ids above this are rare and looked up in the message set directly
+    static constexpr uint32_t CRC_EXTRA_TABLE_SIZE = 1 << 16;
+
+    struct MessageInfo {
+        int16_t crc_extra = CRC_EXTRA_UNRESOLVED;
+        uint16_t max_payload = 0;
+    };
+
+    const mav::MessageSet &_message_set;
+    std::vector<MessageInfo> _messages;
+
+    MessageInfo _lookup(uint32_t message_id) const {
+        auto definition = _message_set.getMessageDefinition(static_cast<int>(message_id));
+        if (!definition.has_value()) {
+            return {CRC_EXTRA_UNKNOWN, 0};
+        }
+        return {static_cast<int16_t>(definition.get().crcExtra()),
+                static_cast<uint16_t>(definition.get().maxPayloadSize())};
+    }
+
+    MessageInfo _info(uint32_t message_id) {
+        if (message_id >= CRC_EXTRA_TABLE_SIZE) {
+            return _lookup(message_id);
+        }
+        MessageInfo &entry = _messages[message_id];
+        if (entry.crc_extra == CRC_EXTRA_UNRESOLVED) {
+            entry = _lookup(message_id);
+        }
+        return entry;
+    }
+
+public:
+    explicit FrameScanner(const mav::MessageSet &message_set) :
+            _message_set(message_set), _messages(CRC_EXTRA_TABLE_SIZE) {}
+
+    static uint16_t crcAccumulate(uint16_t crc, uint8_t byte) {
+        uint8_t tmp = byte ^ static_cast<uint8_t>(crc & 0xFF);
+        tmp ^= static_cast<uint8_t>(tmp << 4);
+        return static_cast<uint16_t>((crc >> 8) ^ (tmp << 8) ^ (tmp << 3) ^ (tmp >> 4));
+    }
+
+    static uint16_t crc(const uint8_t *data, size_t size, uint8_t crc_extra) {
+        const auto &slices = CRC_TABLES.slices;
+        uint16_t crc = 0xFFFF;
+        size_t i = 0;
+        // four independent lookups per step, instead of a dependency chain through every byte
+        for (; i + 4 <= size; i += 4) {
+            const uint16_t low = crc ^ static_cast<uint16_t>(data[i] | (data[i + 1] << 8));
+            crc = slices[3][low & 0xFF] ^ slices[2][low >> 8] ^ slices[1][data[i + 2]] ^ slices[0][data[i + 3]];
+        }
+        for (; i < size; i++) {
+            crc = static_cast<uint16_t>((crc >> 8) ^ slices[0][(crc ^ data[i]) & 0xFF]);
+        }
+        return crcAccumulate(crc, crc_extra);
+    }
+
+    /**
+     * @return the crc_extra byte for a message id, or -1 if the message set does not know it
+     */
+    int16_t crcExtra(uint32_t message_id) {
+        return _info(message_id).crc_extra;
+    }
+
+    /**
+     * Parses only the header of a frame starting at data[0], without validating the checksum.
+     */
+    static Status parseHeader(const uint8_t *data, size_t available, FrameView &frame) {
+        if (available == 0 || (data[0] != MAVLINK_MAGIC_V1 && data[0] != MAVLINK_MAGIC_V2)) {
+            return Status::NO_MAGIC;
+        }
+        frame.data = data;
+        frame.is_v2 = data[0] == MAVLINK_MAGIC_V2;
+        if (available < frame.headerSize()) {
+            return Status::INCOMPLETE;
+        }
+        frame.payload_length = data[1];
+        if (frame.is_v2) {
+            frame.is_signed = (data[2] & MAVLINK_IFLAG_SIGNED) != 0;
+            frame.seq = data[4];
+            frame.system_id = data[5];
+            frame.component_id = data[6];
+            frame.message_id = data[7] | (data[8] << 8) | (data[9] << 16);
+        } else {
+            frame.is_signed = false;
+            frame.seq = data[2];
+            frame.system_id = data[3];
+            frame.component_id = data[4];
+            frame.message_id = data[5];
+        }
+        frame.size = static_cast<uint32_t>(frame.headerSize() + frame.payload_length + MAVLINK_CHECKSUM_SIZE +
+                (frame.is_signed ? MAVLINK_SIGNATURE_SIZE : 0));
+        if (available < frame.size) {
+            return Status::INCOMPLETE;
+        }
+        return Status::VALID;
+    }
+
+    /**
+     * Parses and checksum-validates a frame starting at data[0].
+     */
+    Status parse(const uint8_t *data, size_t available, FrameView &frame) {
+        Status status = parseHeader(data, available, frame);
+        if (status == Status::NO_MAGIC || (status == Status::INCOMPLETE && available < frame.headerSize())) {
+            return status;
+        }
+        // with the header, most false candidates in noise are rejected before waiting for or checksumming the rest
+        const MessageInfo info = _info(frame.message_id);
+        if (info.crc_extra < 0) {
+            return Status::UNKNOWN_MESSAGE;
+        }
+        if (!frame.is_v2 && frame.payload_length > info.max_payload) {
+            // v2 senders with a newer dialect may add extension fields, so only v1 lengths are known
+            return Status::BAD_LENGTH;
+        }
+        if (status == Status::INCOMPLETE) {
+            return status;
+        }
+        const auto crc_extra = info.crc_extra;
+        const size_t checksum_offset = frame.headerSize() + frame.payload_length;
+        uint16_t expected = data[checksum_offset] | (data[checksum_offset + 1] << 8);
+        if (crc(data + 1, checksum_offset - 1, static_cast<uint8_t>(crc_extra)) != expected) {
+            return Status::BAD_CRC;
+        }
+        return Status::VALID;
+    }
+
+    /**
+     * Finds the first valid frame starting in [from, end). The frame itself may extend up to limit.
+     * @return the offset of the frame, or end if there is none
+     */
+    size_t find(const uint8_t *data, size_t from, size_t end, size_t limit, FrameView &frame) {
+        for (size_t offset = findMagic(data, from, end); offset < end; offset = findMagic(data, offset + 1, end)) {
+            if (parse(data + offset, limit - offset, frame) == Status::VALID) {
+                return offset;
+            }
+        }
+        return end;
+    }
+};
+
+#endif //MAVTOOLS_FRAME_H
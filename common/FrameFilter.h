@@ -0,0 +1,158 @@
+/****************************************************************************
+ *
+ * Copyright (c) 2024, libmav development team
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name libmav nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+#ifndef MAVTOOLS_FRAMEFILTER_H
+#define MAVTOOLS_FRAMEFILTER_H
+
+#include <bitset>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <unordered_set>
+
+#include "mav/MessageSet.h"
+#include "Frame.h"
+
+/**
+ * Include / exclude selection on message id, system id and component id, decided from the frame header alone.
+ *
+ * Selectors are comma separated terms: a message name or id, sysid=<n> or compid=<n>.
+ * A frame passes if, for every dimension with include terms, it matches one of them,
+ * and it matches no exclude term.
+ */
+class FrameFilter {
+private:
+    struct Selection {
+        std::unordered_set<uint32_t> messages;
+        std::bitset<256> systems;
+        std::bitset<256> components;
+
+        [[nodiscard]] bool empty() const {
+            return messages.empty() && systems.none() && components.none();
+        }
+    };
+
+    Selection _include;
+    Selection _exclude;
+
+    static int parseNumber(const std::string &text, int max, const std::string &term) {
+        size_t parsed = 0;
+        int value = -1;
+        try {
+            value = std::stoi(text, &parsed);
+        } catch (std::logic_error &) {
+            parsed = 0;
+        }
+        if (parsed == 0 || parsed != text.size() || value < 0 || value > max) {
+            throw std::invalid_argument("Invalid selector: " + term);
+        }
+        return value;
+    }
+
+    static void parseInto(Selection &selection, const std::string &spec, const mav::MessageSet &message_set) {
+        size_t start = 0;
+        while (start <= spec.size()) {
+            size_t end = spec.find(',', start);
+            if (end == std::string::npos) {
+                end = spec.size();
+            }
+            const std::string term = spec.substr(start, end - start);
+            start = end + 1;
+            if (term.empty()) {
+                continue;
+            }
+
+            const size_t equals = term.find('=');
+            const std::string key = equals == std::string::npos ? "msg" : term.substr(0, equals);
+            const std::string value = equals == std::string::npos ? term : term.substr(equals + 1);
+            if (key == "sysid") {
+                selection.systems.set(parseNumber(value, 255, term));
+            } else if (key == "compid") {
+                selection.components.set(parseNumber(value, 255, term));
+            } else if (key == "msg") {
+                auto definition = message_set.getMessageDefinition(value);
+                if (definition.has_value()) {
+                    selection.messages.insert(definition.get().id());
+                } else {
+                    int id = parseNumber(value, 0xFFFFFF, term);
+                    if (!message_set.contains(id)) {
+                        throw std::invalid_argument("Unknown message: " + value);
+                    }
+                    selection.messages.insert(id);
+                }
+            } else {
+                throw std::invalid_argument("Unknown selector key: " + key);
+            }
+        }
+    }
+
+public:
+    /**
+     * @throws std::invalid_argument if the selector can not be parsed
+     */
+    void include(const std::string &spec, const mav::MessageSet &message_set) {
+        parseInto(_include, spec, message_set);
+    }
+
+    /**
+     * @throws std::invalid_argument if the selector can not be parsed
+     */
+    void exclude(const std::string &spec, const mav::MessageSet &message_set) {
+        parseInto(_exclude, spec, message_set);
+    }
+
+    [[nodiscard]] bool empty() const {
+        return _include.empty() && _exclude.empty();
+    }
+
+    [[nodiscard]] bool accepts(uint32_t message_id, uint8_t system_id, uint8_t component_id) const {
+        if (!_include.messages.empty() && _include.messages.count(message_id) == 0) {
+            return false;
+        }
+        if (_include.systems.any() && !_include.systems.test(system_id)) {
+            return false;
+        }
+        if (_include.components.any() && !_include.components.test(component_id)) {
+            return false;
+        }
+        return _exclude.messages.count(message_id) == 0 && !_exclude.systems.test(system_id) &&
+               !_exclude.components.test(component_id);
+    }
+
+    [[nodiscard]] bool accepts(const FrameView &frame) const {
+        return accepts(frame.message_id, frame.system_id, frame.component_id);
+    }
+};
+
+#endif //MAVTOOLS_FRAMEFILTER_H
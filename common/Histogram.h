@@ -0,0 +1,136 @@
+/****************************************************************************
+ *
+ * Copyright (c) 2024, libmav development team
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name libmav nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+#ifndef MAVTOOLS_HISTOGRAM_H
+#define MAVTOOLS_HISTOGRAM_H
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <string>
+
+/**
+ * Histogram with power of two buckets: bucket 0 counts zeros, and bucket n > 0 counts values in [2^(n-1), 2^n).
+ * Adding a value is a handful of instructions, and quantiles are accurate to within a factor of two.
+ */
+class Histogram {
+public:
+    static constexpr size_t BUCKETS = 65;
+
+private:
+    std::array<uint64_t, BUCKETS> _counts{};
+    uint64_t _count = 0;
+    uint64_t _sum = 0;
+    uint64_t _max = 0;
+
+public:
+    static size_t bucket(uint64_t value) {
+        return value == 0 ? 0 : 64 - static_cast<size_t>(__builtin_clzll(value));
+    }
+
+    /**
+     * @return the smallest value that falls into a bucket
+     */
+    static uint64_t lowerBound(size_t bucket) {
+        return bucket == 0 ? 0 : uint64_t{1} << (bucket - 1);
+    }
+
+    void add(uint64_t value) {
+        _counts[bucket(value)]++;
+        _count++;
+        _sum += value;
+        _max = std::max(_max, value);
+    }
+
+    void merge(const Histogram &other) {
+        for (size_t i = 0; i < BUCKETS; i++) {
+            _counts[i] += other._counts[i];
+        }
+        _count += other._count;
+        _sum += other._sum;
+        _max = std::max(_max, other._max);
+    }
+
+    [[nodiscard]] uint64_t count() const {
+        return _count;
+    }
+
+    [[nodiscard]] uint64_t count(size_t bucket) const {
+        return _counts[bucket];
+    }
+
+    [[nodiscard]] uint64_t max() const {
+        return _max;
+    }
+
+    [[nodiscard]] double mean() const {
+        return _count > 0 ? static_cast<double>(_sum) / static_cast<double>(_count) : 0.0;
+    }
+
+    /**
+     * @return an upper bound for the q-quantile, q in [0, 1]
+     */
+    [[nodiscard]] uint64_t quantile(double q) const {
+        const auto rank = static_cast<uint64_t>(q * static_cast<double>(_count));
+        uint64_t seen = 0;
+        for (size_t i = 0; i < BUCKETS; i++) {
+            seen += _counts[i];
+            if (seen > rank || seen == _count) {
+                return std::min(i == 0 ? 0 : (lowerBound(i) << 1) - 1, _max);
+            }
+        }
+        return _max;
+    }
+
+    /**
+     * @return a human readable summary and one line per non-empty bucket
+     */
+    [[nodiscard]] std::string format(const std::string &unit) const {
+        std::string text = "count " + std::to_string(_count) + ", mean " + std::to_string(static_cast<uint64_t>(mean())) +
+                " " + unit + ", p50 " + std::to_string(quantile(0.5)) + " " + unit +
+                ", p99 " + std::to_string(quantile(0.99)) + " " + unit +
+                ", max " + std::to_string(_max) + " " + unit + "\n";
+        for (size_t i = 0; i < BUCKETS; i++) {
+            if (_counts[i] == 0) {
+                continue;
+            }
+            std::string range = i == 0 ? "0" : std::to_string(lowerBound(i)) + " - " + std::to_string((lowerBound(i) << 1) - 1);
+            text += "  " + std::string(std::max<size_t>(24, range.size()) - range.size(), ' ') + range + " " + unit +
+                    ": " + std::to_string(_counts[i]) + "\n";
+        }
+        return text;
+    }
+};
+
+#endif //MAVTOOLS_HISTOGRAM_H
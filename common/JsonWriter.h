@@ -0,0 +1,126 @@
+/****************************************************************************
+ *
+ * Copyright (c) 2024, libmav development team
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name libmav nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+#ifndef MAVTOOLS_JSONWRITER_H
+#define MAVTOOLS_JSONWRITER_H
+
+#include <charconv>
+#include <cmath>
+#include <cstring>
+#include <string>
+#include <string_view>
+
+#include "mav/utils.h"
+
+/**
+ * Formats a finite number, floats in the shortest representation that round-trips to the same value.
+ * @return the end of the formatted characters
+ */
+template<typename T>
+char *formatNumber(char *first, char *last, const T &arg) {
+    if constexpr (mav::is_any<std::decay_t<T>, char, uint8_t, int8_t>::value) {
+        // cast to int to avoid printing as a char
+        return std::to_chars(first, last, static_cast<int>(arg)).ptr;
+    } else {
+        return std::to_chars(first, last, arg).ptr;
+    }
+}
+
+/**
+ * Appends JSON tokens to a reusable buffer. The buffer keeps its capacity
+ * across clear() calls, so steady-state serialization does not allocate.
+ */
+class JsonWriter {
+private:
+    std::string _buffer;
+
+public:
+    JsonWriter() {
+        _buffer.reserve(4096);
+    }
+
+    void clear() {
+        _buffer.clear();
+    }
+
+    [[nodiscard]] std::string_view view() const {
+        return _buffer;
+    }
+
+    JsonWriter &raw(std::string_view text) {
+        _buffer.append(text);
+        return *this;
+    }
+
+    JsonWriter &raw(char c) {
+        _buffer.push_back(c);
+        return *this;
+    }
+
+    template<typename T>
+    JsonWriter &number(const T &arg) {
+        if constexpr (std::is_floating_point<T>::value) {
+            if (std::isnan(arg)) {
+                return raw("\"NaN\""); // JSON does not support NaN, so we print it as a string
+            } else if (std::isinf(arg) && arg > 0) {
+                return raw("\"Infinity\""); // JSON does not support Infinity, so we print it as a string
+            } else if (std::isinf(arg) && arg < 0) {
+                return raw("\"-Infinity\""); // JSON does not support -Infinity, so we print it as a string
+            }
+        }
+        char chars[32];
+        _buffer.append(chars, formatNumber(chars, chars + sizeof(chars), arg) - chars);
+        return *this;
+    }
+
+    JsonWriter &string(std::string_view text) {
+        static constexpr char HEX[] = "0123456789abcdef";
+        _buffer.push_back('"');
+        for (char c : text) {
+            if (c == '"' || c == '\\') {
+                _buffer.push_back('\\');
+                _buffer.push_back(c);
+            } else if (static_cast<unsigned char>(c) < 0x20) {
+                const char escaped[] = {'\\', 'u', '0', '0', HEX[(c >> 4) & 0xF], HEX[c & 0xF]};
+                _buffer.append(escaped, sizeof(escaped));
+            } else {
+                _buffer.push_back(c);
+            }
+        }
+        _buffer.push_back('"');
+        return *this;
+    }
+};
+
+#endif //MAVTOOLS_JSONWRITER_H
@@ -0,0 +1,115 @@
+/****************************************************************************
+ *
+ * Copyright (c) 2024, libmav development team
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name libmav nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+#ifndef MAVTOOLS_MAPPEDFILE_H
+#define MAVTOOLS_MAPPEDFILE_H
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/**
+ * Memory mapping of a regular file, advised for sequential access. Read-only by default,
+ * or a private copy-on-write mapping for in-place parsing that never touches the file.
+ */
+class MappedFile {
+private:
+    uint8_t *_data = nullptr;
+    size_t _size = 0;
+
+public:
+    static bool isRegularFile(const std::string &path) {
+        struct stat file_stat{};
+        return ::stat(path.c_str(), &file_stat) == 0 && S_ISREG(file_stat.st_mode);
+    }
+
+    explicit MappedFile(const std::string &path, bool copy_on_write = false) {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            throw std::runtime_error("Could not open " + path + ": " + std::strerror(errno));
+        }
+        struct stat file_stat{};
+        if (::fstat(fd, &file_stat) != 0) {
+            ::close(fd);
+            throw std::runtime_error("Could not stat " + path + ": " + std::strerror(errno));
+        }
+        _size = static_cast<size_t>(file_stat.st_size);
+        if (_size > 0) {
+            void *mapping = ::mmap(nullptr, _size, copy_on_write ? PROT_READ | PROT_WRITE : PROT_READ,
+                                   MAP_PRIVATE, fd, 0);
+            if (mapping == MAP_FAILED) {
+                ::close(fd);
+                throw std::runtime_error("Could not map " + path + ": " + std::strerror(errno));
+            }
+            // readahead aggressively, and drop pages behind us
+            ::madvise(mapping, _size, MADV_SEQUENTIAL);
+            _data = static_cast<uint8_t *>(mapping);
+        }
+        // the mapping stays valid after closing the descriptor
+        ::close(fd);
+    }
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    ~MappedFile() {
+        if (_data) {
+            ::munmap(_data, _size);
+        }
+    }
+
+    [[nodiscard]] const uint8_t *data() const {
+        return _data;
+    }
+
+    /**
+     * Only valid for copy-on-write mappings.
+     */
+    [[nodiscard]] uint8_t *mutableData() {
+        return _data;
+    }
+
+    [[nodiscard]] size_t size() const {
+        return _size;
+    }
+};
+
+#endif //MAVTOOLS_MAPPEDFILE_H
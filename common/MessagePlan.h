@@ -0,0 +1,292 @@
+/****************************************************************************
+ *
+ * Copyright (c) 2024, libmav development team
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name libmav nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+#ifndef MAVTOOLS_MESSAGEPLAN_H
+#define MAVTOOLS_MESSAGEPLAN_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "mav/MessageSet.h"
+#include "Frame.h"
+
+/**
+ * Where and how to read one field straight from the payload bytes.
+ */
+struct FieldPlan {
+    std::string name;
+    std::string json_key;   // pre-escaped "name": fragment, with a leading comma unless it is the first field
+    mav::FieldType::BaseType type;
+    int offset;
+    int count;              // number of elements, 1 for scalars
+
+    [[nodiscard]] bool isArray() const {
+        return count > 1;
+    }
+};
+
+template<typename T>
+struct TypeTag {
+    using type = T;
+};
+
+/**
+ * Calls f(TypeTag<T>{}) with the C++ type of a numeric base type. CHAR is passed as char.
+ */
+template<typename F>
+void dispatchBaseType(mav::FieldType::BaseType base_type, F &&f) {
+    using BaseType = mav::FieldType::BaseType;
+    switch (base_type) {
+        case BaseType::CHAR: f(TypeTag<char>{}); break;
+        case BaseType::UINT8: f(TypeTag<uint8_t>{}); break;
+        case BaseType::UINT16: f(TypeTag<uint16_t>{}); break;
+        case BaseType::UINT32: f(TypeTag<uint32_t>{}); break;
+        case BaseType::UINT64: f(TypeTag<uint64_t>{}); break;
+        case BaseType::INT8: f(TypeTag<int8_t>{}); break;
+        case BaseType::INT16: f(TypeTag<int16_t>{}); break;
+        case BaseType::INT32: f(TypeTag<int32_t>{}); break;
+        case BaseType::INT64: f(TypeTag<int64_t>{}); break;
+        case BaseType::FLOAT: f(TypeTag<float>{}); break;
+        case BaseType::DOUBLE: f(TypeTag<double>{}); break;
+    }
+}
+
+inline int baseTypeSize(mav::FieldType::BaseType base_type) {
+    int size = 0;
+    dispatchBaseType(base_type, [&size](auto tag) {
+        size = sizeof(typename decltype(tag)::type);
+    });
+    return size;
+}
+
+template<typename T>
+T readPayloadValue(const uint8_t *payload, int offset) {
+    // MAVLink payloads are little endian and unaligned
+    T value;
+    std::memcpy(&value, payload + offset, sizeof(T));
+    return value;
+}
+
+/**
+ * Precompiled serialization plan for one message type, resolved once against its definition.
+ */
+struct MessagePlan {
+    const mav::MessageDefinition *definition;
+    std::string json_name;  // pre-escaped "NAME" string
+    std::vector<FieldPlan> fields;
+    size_t payload_size;    // bytes covered by the fields
+
+    static MessagePlan build(const mav::MessageDefinition &definition, const std::vector<std::string> &field_names) {
+        MessagePlan plan{&definition, "\"" + definition.name() + "\"", {}, 0};
+        for (const auto &name : field_names) {
+            const auto &field = definition.fieldForName(name);
+            std::string key = plan.fields.empty() ? "\"" : ",\"";
+            key.append(name).append("\":");
+            plan.fields.push_back({name, std::move(key), field.type.base_type, field.offset, field.type.size});
+            plan.payload_size = std::max(plan.payload_size,
+                    static_cast<size_t>(field.offset + baseTypeSize(field.type.base_type) * field.type.size));
+        }
+        return plan;
+    }
+
+    static MessagePlan build(const mav::MessageDefinition &definition) {
+        return build(definition, definition.fieldNames());
+    }
+};
+
+/**
+ * Restricts the serialized fields to a selection of MSG.field pairs, resolved once against the message set.
+ * Messages without selected fields are not part of the projection.
+ */
+class FieldProjection {
+private:
+    std::unordered_map<uint32_t, MessagePlan> _plans;
+    std::vector<uint32_t> _order;
+    std::unordered_map<uint32_t, std::vector<std::string>> _fields;
+
+public:
+    /**
+     * Adds comma separated MSG.field terms.
+     * @throws std::invalid_argument on unknown messages or fields
+     */
+    void add(const std::string &spec, const mav::MessageSet &message_set) {
+        size_t start = 0;
+        while (start <= spec.size()) {
+            size_t end = spec.find(',', start);
+            if (end == std::string::npos) {
+                end = spec.size();
+            }
+            const std::string term = spec.substr(start, end - start);
+            start = end + 1;
+            if (term.empty()) {
+                continue;
+            }
+
+            const size_t dot = term.find('.');
+            if (dot == std::string::npos) {
+                throw std::invalid_argument("Expected MSG.field, got: " + term);
+            }
+            const std::string message_name = term.substr(0, dot);
+            const std::string field_name = term.substr(dot + 1);
+            auto definition = message_set.getMessageDefinition(message_name);
+            if (!definition.has_value()) {
+                throw std::invalid_argument("Unknown message: " + message_name);
+            }
+            if (!definition.get().containsField(field_name)) {
+                throw std::invalid_argument("Unknown field: " + field_name + " on message " + message_name);
+            }
+
+            const auto id = static_cast<uint32_t>(definition.get().id());
+            auto &fields = _fields[id];
+            if (fields.empty()) {
+                _order.push_back(id);
+            }
+            if (std::find(fields.begin(), fields.end(), field_name) == fields.end()) {
+                fields.push_back(field_name);
+            }
+            _plans.erase(id);
+            _plans.emplace(id, MessagePlan::build(definition.get(), fields));
+        }
+    }
+
+    [[nodiscard]] bool empty() const {
+        return _plans.empty();
+    }
+
+    /**
+     * @return the projected plan for a message id, or nullptr if the message is not projected
+     */
+    [[nodiscard]] const MessagePlan *plan(uint32_t message_id) const {
+        auto it = _plans.find(message_id);
+        return it == _plans.end() ? nullptr : &it->second;
+    }
+
+    /**
+     * @return the projected plans, in the order the messages were first named
+     */
+    [[nodiscard]] std::vector<const MessagePlan *> plans() const {
+        std::vector<const MessagePlan *> result;
+        for (uint32_t id : _order) {
+            result.push_back(&_plans.at(id));
+        }
+        return result;
+    }
+};
+
+/**
+ * Lazily built plans, keyed by message id. Projected messages use the projection's plan.
+ */
+class MessagePlanCache {
+private:
+    const mav::MessageSet &_message_set;
+    const FieldProjection *_projection;
+    std::unordered_map<uint32_t, std::unique_ptr<MessagePlan>> _plans;
+
+public:
+    explicit MessagePlanCache(const mav::MessageSet &message_set, const FieldProjection *projection = nullptr) :
+            _message_set(message_set), _projection(projection) {}
+
+    /**
+     * @return the plan for a message id, or nullptr if the message set does not contain it
+     */
+    const MessagePlan *get(uint32_t message_id) {
+        if (_projection && !_projection->empty()) {
+            return _projection->plan(message_id);
+        }
+        auto it = _plans.find(message_id);
+        if (it == _plans.end()) {
+            auto definition = _message_set.getMessageDefinition(static_cast<int>(message_id));
+            std::unique_ptr<MessagePlan> plan;
+            if (definition.has_value()) {
+                plan = std::make_unique<MessagePlan>(MessagePlan::build(definition.get()));
+            }
+            it = _plans.emplace(message_id, std::move(plan)).first;
+        }
+        return it->second.get();
+    }
+};
+
+/**
+ * The header values and payload of one message, whether it comes from a raw frame or a mav::Message.
+ */
+struct RawMessage {
+    uint32_t message_id;
+    uint8_t system_id;
+    uint8_t component_id;
+    uint8_t seq;
+    bool is_signed;
+    const uint8_t *payload;
+    size_t payload_length;
+    uint64_t timestamp_us = 0;  // receive time, if the input has one
+
+    static RawMessage fromFrame(const FrameView &frame, uint64_t timestamp_us = 0) {
+        return {frame.message_id, frame.system_id, frame.component_id, frame.seq, frame.is_signed,
+                frame.payload(), frame.payload_length, timestamp_us};
+    }
+
+    static RawMessage fromMessage(const mav::Message &message) {
+        // messages keep their data in MAVLink 2 wire format
+        return {static_cast<uint32_t>(message.id()), message.header().systemId(), message.header().componentId(),
+                message.header().seq(), message.header().isSigned(), message.data() + MAVLINK_HEADER_SIZE_V2,
+                message.header().len()};
+    }
+};
+
+/**
+ * MAVLink 2 truncates trailing zero bytes of the payload. This restores them into a scratch
+ * buffer when needed, so plans can read every field without bounds checks.
+ */
+class PayloadBuffer {
+private:
+    static constexpr size_t MAX_PAYLOAD_SIZE = 255;
+    uint8_t _buffer[MAX_PAYLOAD_SIZE + 1]{};
+
+public:
+    const uint8_t *extend(const uint8_t *payload, size_t payload_length, size_t required_size) {
+        if (payload_length >= required_size) {
+            return payload;
+        }
+        std::memcpy(_buffer, payload, payload_length);
+        std::memset(_buffer + payload_length, 0, std::min(required_size, sizeof(_buffer)) - payload_length);
+        return _buffer;
+    }
+};
+
+#endif //MAVTOOLS_MESSAGEPLAN_H
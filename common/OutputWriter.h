@@ -0,0 +1,257 @@
+/****************************************************************************
+ *
+ * Copyright (c) 2024, libmav development team
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name libmav nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+#ifndef MAVTOOLS_OUTPUTWRITER_H
+#define MAVTOOLS_OUTPUTWRITER_H
+
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+
+#include <unistd.h>
+
+#include "Histogram.h"
+
+/**
+ * Double buffered, asynchronous writer for output records.
+ * The producer appends to the front buffer, while a dedicated thread writes
+ * the back buffer to the file descriptor in large blocks.
+ */
+class OutputWriter {
+public:
+    enum class FlushPolicy {
+        MESSAGE,    // hand off every record immediately, for live tailing
+        INTERVAL,   // hand off whatever is buffered every flush interval
+        FULL        // hand off only when the buffer is full
+    };
+
+    static std::optional<FlushPolicy> parseFlushPolicy(const std::string &name) {
+        if (name == "message") {
+            return FlushPolicy::MESSAGE;
+        } else if (name == "interval") {
+            return FlushPolicy::INTERVAL;
+        } else if (name == "full") {
+            return FlushPolicy::FULL;
+        }
+        return std::nullopt;
+    }
+
+    /**
+     * Counters are totals, histograms only cover the time since the statistics were taken last.
+     */
+    struct Statistics {
+        uint64_t written_bytes = 0;
+        uint64_t hand_offs = 0;
+        size_t buffered_bytes = 0;
+        Histogram producer_blocked_us;  // producer waiting for the writer thread to take a buffer
+        Histogram write_us;             // writer thread writing one buffer
+    };
+
+private:
+    static constexpr size_t DEFAULT_BUFFER_SIZE = 1024 * 1024; // 1 MiB
+
+    const int _fd;
+    const FlushPolicy _policy;
+    const std::chrono::milliseconds _interval;
+    const size_t _buffer_size;
+
+    std::string _front;
+    std::string _back;
+    bool _back_pending = false;
+    bool _stopping = false;
+    bool _failed = false;
+    // timing is only measured when enabled, everything else is counted under the mutex anyway
+    bool _statistics_enabled = false;
+    Statistics _statistics;
+    std::mutex _mutex;
+    std::condition_variable _cv;
+    std::thread _thread;
+
+    // requires _mutex to be held
+    void _handOff(std::unique_lock<std::mutex> &lock) {
+        if (_statistics_enabled && _back_pending) {
+            const auto start = std::chrono::steady_clock::now();
+            _cv.wait(lock, [this] { return !_back_pending; });
+            _statistics.producer_blocked_us.add(std::chrono::duration_cast<std::chrono::microseconds>(
+                    std::chrono::steady_clock::now() - start).count());
+        } else {
+            _cv.wait(lock, [this] { return !_back_pending; });
+        }
+        _statistics.hand_offs++;
+        std::swap(_front, _back);
+        _back_pending = true;
+        _cv.notify_all();
+    }
+
+    void _writeAll(const std::string &data) {
+        size_t written = 0;
+        while (written < data.size() && !_failed) {
+            ssize_t res = ::write(_fd, data.data() + written, data.size() - written);
+            if (res < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                std::cerr << "Error writing output: " << std::strerror(errno) << std::endl;
+                _failed = true;
+            } else {
+                written += static_cast<size_t>(res);
+            }
+        }
+    }
+
+    void _run() {
+        std::unique_lock<std::mutex> lock(_mutex);
+        while (true) {
+            auto ready = [this] { return _back_pending || _stopping; };
+            if (_policy == FlushPolicy::INTERVAL) {
+                if (!_cv.wait_for(lock, _interval, ready) && !_front.empty()) {
+                    // the producer may be idle, so pick up what it buffered so far
+                    std::swap(_front, _back);
+                    _back_pending = true;
+                    _statistics.hand_offs++;
+                }
+            } else {
+                _cv.wait(lock, ready);
+            }
+
+            if (_back_pending) {
+                const bool timed = _statistics_enabled;
+                lock.unlock();
+                const auto start = timed ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point{};
+                _writeAll(_back);
+                const auto end = timed ? std::chrono::steady_clock::now() : start;
+                lock.lock();
+                if (timed) {
+                    _statistics.write_us.add(std::chrono::duration_cast<std::chrono::microseconds>(end - start).count());
+                }
+                _statistics.written_bytes += _back.size();
+                _back.clear();
+                _back_pending = false;
+                _cv.notify_all();
+            } else if (_stopping) {
+                return;
+            }
+        }
+    }
+
+public:
+    OutputWriter(int fd, FlushPolicy policy, std::chrono::milliseconds interval,
+                 size_t buffer_size = DEFAULT_BUFFER_SIZE) :
+            _fd(fd), _policy(policy), _interval(interval), _buffer_size(buffer_size) {
+        _front.reserve(_buffer_size);
+        _back.reserve(_buffer_size);
+        _thread = std::thread([this] { _run(); });
+    }
+
+    OutputWriter(const OutputWriter &) = delete;
+    OutputWriter &operator=(const OutputWriter &) = delete;
+
+    ~OutputWriter() {
+        close();
+    }
+
+    /**
+     * Appends one or more complete records.
+     */
+    void write(std::string_view records) {
+        if (records.empty()) {
+            return;
+        }
+        std::unique_lock<std::mutex> lock(_mutex);
+        if (!_front.empty() && _front.size() + records.size() > _buffer_size) {
+            _handOff(lock);
+        }
+        _front.append(records);
+        if (_policy == FlushPolicy::MESSAGE || _front.size() >= _buffer_size) {
+            _handOff(lock);
+        }
+    }
+
+    /**
+     * Starts measuring how long the producer and the writer thread wait for each other.
+     */
+    void enableStatistics() {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _statistics_enabled = true;
+    }
+
+    /**
+     * @return the statistics so far, and restarts the histograms
+     */
+    Statistics takeStatistics() {
+        std::lock_guard<std::mutex> lock(_mutex);
+        Statistics statistics = _statistics;
+        statistics.buffered_bytes = _front.size() + (_back_pending ? _back.size() : 0);
+        _statistics.producer_blocked_us = {};
+        _statistics.write_us = {};
+        return statistics;
+    }
+
+    /**
+     * Hands off everything buffered so far to the writer thread.
+     */
+    void flush() {
+        std::unique_lock<std::mutex> lock(_mutex);
+        if (!_front.empty()) {
+            _handOff(lock);
+        }
+    }
+
+    /**
+     * Writes out all buffered data and stops the writer thread.
+     */
+    void close() {
+        if (!_thread.joinable()) {
+            return;
+        }
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            if (!_front.empty()) {
+                _handOff(lock);
+            }
+            _stopping = true;
+            _cv.notify_all();
+        }
+        _thread.join();
+    }
+};
+
+#endif //MAVTOOLS_OUTPUTWRITER_H
@@ -0,0 +1,346 @@
+/****************************************************************************
+ *
+ * Copyright (c) 2024, libmav development team
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name libmav nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+#ifndef MAVTOOLS_RECORDSERIALIZER_H
+#define MAVTOOLS_RECORDSERIALIZER_H
+
+#include <cmath>
+#include <cstring>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "BinaryWriter.h"
+#include "JsonWriter.h"
+#include "MessagePlan.h"
+
+enum class OutputFormat {
+    JSON,
+    CSV,
+    TSV,
+    CBOR,
+    MSGPACK,
+    RAW     // the original frame bytes, without a serializer
+};
+
+inline std::optional<OutputFormat> parseOutputFormat(const std::string &name) {
+    if (name == "json") {
+        return OutputFormat::JSON;
+    } else if (name == "csv") {
+        return OutputFormat::CSV;
+    } else if (name == "tsv") {
+        return OutputFormat::TSV;
+    } else if (name == "cbor") {
+        return OutputFormat::CBOR;
+    } else if (name == "msgpack") {
+        return OutputFormat::MSGPACK;
+    } else if (name == "raw") {
+        return OutputFormat::RAW;
+    }
+    return std::nullopt;
+}
+
+/**
+ * Turns one message into one complete output record, including its terminator.
+ */
+class RecordSerializer {
+protected:
+    PayloadBuffer _payload_buffer;
+    // whether records include the receive time of the message
+    const bool _timestamps;
+
+    /**
+     * @return the payload, with truncated trailing zeros restored as far as the plan needs them
+     */
+    const uint8_t *payload(const MessagePlan &plan, const RawMessage &message) {
+        return _payload_buffer.extend(message.payload, message.payload_length, plan.payload_size);
+    }
+
+public:
+    explicit RecordSerializer(bool timestamps) : _timestamps(timestamps) {}
+
+    virtual ~RecordSerializer() = default;
+
+    /**
+     * @return records to be written before any message, e.g. a header row
+     */
+    virtual std::string preamble(const std::vector<const MessagePlan *> &) {
+        return {};
+    }
+
+    /**
+     * @return a view of the record, valid until the next call
+     */
+    virtual std::string_view serialize(const MessagePlan &plan, const RawMessage &message) = 0;
+};
+
+/**
+ * The newline-delimited JSON record format that mavencode consumes.
+ */
+class JsonRecordSerializer : public RecordSerializer {
+private:
+    JsonWriter _writer;
+
+    void _field(const FieldPlan &field, const uint8_t *payload) {
+        _writer.raw(field.json_key);
+        if (field.type == mav::FieldType::BaseType::CHAR) {
+            const char *text = reinterpret_cast<const char *>(payload + field.offset);
+            _writer.string(std::string_view{text, strnlen(text, field.count)});
+            return;
+        }
+        dispatchBaseType(field.type, [this, &field, payload](auto tag) {
+            using T = typename decltype(tag)::type;
+            if (!field.isArray()) {
+                _writer.number(readPayloadValue<T>(payload, field.offset));
+                return;
+            }
+            _writer.raw('[');
+            for (int i = 0; i < field.count; i++) {
+                if (i > 0)
+                    _writer.raw(", ");
+                _writer.number(readPayloadValue<T>(payload, field.offset + i * static_cast<int>(sizeof(T))));
+            }
+            _writer.raw(']');
+        });
+    }
+
+public:
+    explicit JsonRecordSerializer(bool timestamps) : RecordSerializer(timestamps) {}
+
+    std::string_view serialize(const MessagePlan &plan, const RawMessage &message) override {
+        const uint8_t *data = payload(plan, message);
+        _writer.clear();
+        _writer.raw("{\"id\": ").number(message.message_id);
+        _writer.raw(", \"name\": ").raw(plan.json_name);
+        _writer.raw(", \"system_id\": ").number(message.system_id);
+        _writer.raw(", \"component_id\": ").number(message.component_id);
+        _writer.raw(", \"seq\": ").number(message.seq);
+        if (_timestamps) {
+            _writer.raw(", \"timestamp_us\": ").number(message.timestamp_us);
+        }
+        _writer.raw(", \"fields\": { ");
+        for (const auto &field : plan.fields) {
+            _field(field, data);
+        }
+        _writer.raw("}}\n");
+        return _writer.view();
+    }
+};
+
+/**
+ * The JSON record structure in a binary format, CborWriter or MsgPackWriter. Records are simply concatenated.
+ * Floats keep their native IEEE representation, including non-finite values, and arrays other than char arrays
+ * are copied from the payload as little endian typed arrays.
+ */
+template<typename Writer>
+class BinaryRecordSerializer : public RecordSerializer {
+private:
+    Writer _writer;
+
+public:
+    explicit BinaryRecordSerializer(bool timestamps) : RecordSerializer(timestamps) {}
+
+    std::string_view serialize(const MessagePlan &plan, const RawMessage &message) override {
+        const uint8_t *data = payload(plan, message);
+        _writer.clear();
+        _writer.map(_timestamps ? 7 : 6);
+        _writer.text("id").number(message.message_id);
+        _writer.text("name").text(plan.definition->name());
+        _writer.text("system_id").number(message.system_id);
+        _writer.text("component_id").number(message.component_id);
+        _writer.text("seq").number(message.seq);
+        if (_timestamps) {
+            _writer.text("timestamp_us").number(message.timestamp_us);
+        }
+        _writer.text("fields").map(plan.fields.size());
+        for (const auto &field : plan.fields) {
+            _writer.text(field.name);
+            if (field.type == mav::FieldType::BaseType::CHAR) {
+                const char *text = reinterpret_cast<const char *>(data + field.offset);
+                _writer.text(std::string_view{text, strnlen(text, field.count)});
+                continue;
+            }
+            dispatchBaseType(field.type, [this, &field, data](auto tag) {
+                using T = typename decltype(tag)::type;
+                if (field.isArray()) {
+                    _writer.template typedArray<T>(data + field.offset, field.count);
+                } else {
+                    _writer.number(readPayloadValue<T>(data, field.offset));
+                }
+            });
+        }
+        return _writer.view();
+    }
+};
+
+/**
+ * Compact CSV / TSV rows: message name, system id, component id, optionally the receive time, then one column per field value.
+ * Arrays are expanded into one column per element. Non-finite floats are written as NaN, Infinity and -Infinity.
+ */
+class DelimitedRecordSerializer : public RecordSerializer {
+private:
+    const char _delimiter;
+    std::string _buffer;
+
+    template<typename T>
+    void _number(const T &arg) {
+        if constexpr (std::is_floating_point<T>::value) {
+            if (std::isnan(arg)) {
+                _buffer.append("NaN");
+                return;
+            } else if (std::isinf(arg)) {
+                _buffer.append(arg > 0 ? "Infinity" : "-Infinity");
+                return;
+            }
+        }
+        char chars[32];
+        _buffer.append(chars, formatNumber(chars, chars + sizeof(chars), arg) - chars);
+    }
+
+    void _text(std::string_view text) {
+        if (_delimiter == '\t') {
+            // TSV has no quoting, so escape the characters that would break the row
+            for (char c : text) {
+                switch (c) {
+                    case '\t': _buffer.append("\\t"); break;
+                    case '\n': _buffer.append("\\n"); break;
+                    case '\r': _buffer.append("\\r"); break;
+                    case '\\': _buffer.append("\\\\"); break;
+                    default: _buffer.push_back(c);
+                }
+            }
+        } else if (text.find_first_of(",\"\r\n") != std::string_view::npos) {
+            _buffer.push_back('"');
+            for (char c : text) {
+                if (c == '"') {
+                    _buffer.push_back('"');
+                }
+                _buffer.push_back(c);
+            }
+            _buffer.push_back('"');
+        } else {
+            _buffer.append(text);
+        }
+    }
+
+public:
+    DelimitedRecordSerializer(char delimiter, bool timestamps) : RecordSerializer(timestamps), _delimiter(delimiter) {
+        _buffer.reserve(4096);
+    }
+
+    /**
+     * One header row per message type.
+     */
+    std::string preamble(const std::vector<const MessagePlan *> &plans) override {
+        std::string header;
+        for (const auto *plan : plans) {
+            _buffer.clear();
+            _buffer.append("name").push_back(_delimiter);
+            _buffer.append("system_id").push_back(_delimiter);
+            _buffer.append("component_id");
+            if (_timestamps) {
+                _buffer.push_back(_delimiter);
+                _buffer.append("timestamp_us");
+            }
+            for (const auto &field : plan->fields) {
+                const int columns = field.type == mav::FieldType::BaseType::CHAR ? 1 : field.count;
+                for (int i = 0; i < columns; i++) {
+                    _buffer.push_back(_delimiter);
+                    _text(field.name);
+                    if (columns > 1) {
+                        _buffer.append("[").append(std::to_string(i)).append("]");
+                    }
+                }
+            }
+            _buffer.push_back('\n');
+            header.append(_buffer);
+        }
+        return header;
+    }
+
+    std::string_view serialize(const MessagePlan &plan, const RawMessage &message) override {
+        const uint8_t *data = payload(plan, message);
+        _buffer.clear();
+        _text(plan.definition->name());
+        _buffer.push_back(_delimiter);
+        _number(message.system_id);
+        _buffer.push_back(_delimiter);
+        _number(message.component_id);
+        if (_timestamps) {
+            _buffer.push_back(_delimiter);
+            _number(message.timestamp_us);
+        }
+        for (const auto &field : plan.fields) {
+            _buffer.push_back(_delimiter);
+            if (field.type == mav::FieldType::BaseType::CHAR) {
+                const char *text = reinterpret_cast<const char *>(data + field.offset);
+                _text(std::string_view{text, strnlen(text, field.count)});
+                continue;
+            }
+            dispatchBaseType(field.type, [this, &field, data](auto tag) {
+                using T = typename decltype(tag)::type;
+                for (int i = 0; i < field.count; i++) {
+                    if (i > 0)
+                        _buffer.push_back(_delimiter);
+                    _number(readPayloadValue<T>(data, field.offset + i * static_cast<int>(sizeof(T))));
+                }
+            });
+        }
+        _buffer.push_back('\n');
+        return _buffer;
+    }
+};
+
+inline std::unique_ptr<RecordSerializer> makeRecordSerializer(OutputFormat format, bool timestamps = false) {
+    switch (format) {
+        case OutputFormat::CSV:
+            return std::make_unique<DelimitedRecordSerializer>(',', timestamps);
+        case OutputFormat::TSV:
+            return std::make_unique<DelimitedRecordSerializer>('\t', timestamps);
+        case OutputFormat::CBOR:
+            return std::make_unique<BinaryRecordSerializer<CborWriter>>(timestamps);
+        case OutputFormat::MSGPACK:
+            return std::make_unique<BinaryRecordSerializer<MsgPackWriter>>(timestamps);
+        case OutputFormat::RAW:
+            // frames are copied as they are, see RecordFormatter
+            return nullptr;
+        case OutputFormat::JSON:
+        default:
+            return std::make_unique<JsonRecordSerializer>(timestamps);
+    }
+}
+
+#endif //MAVTOOLS_RECORDSERIALIZER_H
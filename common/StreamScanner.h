@@ -0,0 +1,199 @@
+/****************************************************************************
+ *
+ * Copyright (c) 2024, libmav development team
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name libmav nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+#ifndef MAVTOOLS_STREAMSCANNER_H
+#define MAVTOOLS_STREAMSCANNER_H
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "Frame.h"
+
+/**
+ * Incrementally frames a byte stream that arrives in arbitrary blocks, without a StreamParser.
+ * Blocks are read straight into the scanner's buffer, and only the tail of an incomplete frame
+ * is ever moved.
+ */
+class StreamScanner {
+private:
+    static constexpr size_t MAX_FRAME_SIZE = MAVLINK_HEADER_SIZE_V2 + 255 + MAVLINK_CHECKSUM_SIZE + MAVLINK_SIGNATURE_SIZE;
+
+    FrameScanner &_scanner;
+    std::vector<uint8_t> _buffer;
+    size_t _begin = 0;
+    size_t _end = 0;
+    // the next byte is where the previous valid frame ended, so a frame is expected there
+    bool _in_sync = false;
+    uint64_t _discarded_bytes = 0;
+
+public:
+    explicit StreamScanner(FrameScanner &scanner, size_t block_size = 64 * 1024) :
+            _scanner(scanner), _buffer(block_size + MAX_FRAME_SIZE) {}
+
+    /**
+     * @return where to put the next block, with room for at least writableSize() bytes
+     */
+    uint8_t *writePointer() {
+        if (_begin > 0) {
+            // keep the incomplete tail, and make room behind it
+            std::memmove(_buffer.data(), _buffer.data() + _begin, _end - _begin);
+            _end -= _begin;
+            _begin = 0;
+        }
+        return _buffer.data() + _end;
+    }
+
+    [[nodiscard]] size_t writableSize() const {
+        return _buffer.size() - _end;
+    }
+
+    /**
+     * Marks size bytes behind writePointer() as received.
+     */
+    void commit(size_t size) {
+        _end += size;
+    }
+
+    void append(const uint8_t *data, size_t size) {
+        while (size > 0) {
+            uint8_t *destination = writePointer();
+            size_t count = std::min(size, writableSize());
+            std::memcpy(destination, data, count);
+            commit(count);
+            data += count;
+            size -= count;
+            if (size > 0) {
+                // no consumer in between, so drop the oldest bytes
+                _discarded_bytes += _end - _begin;
+                _begin = _end;
+                _in_sync = false;
+            }
+        }
+    }
+
+    /**
+     * Frames one block of memory, like scan() does with the received data, and stops at an incomplete frame.
+     * in_sync tells whether a frame is expected at data[0], and is updated for the end of the consumed bytes.
+     * @return the number of bytes consumed, up to an incomplete frame
+     */
+    template<typename OnFrame, typename OnCrcError>
+    static size_t scanBlock(FrameScanner &scanner, const uint8_t *block, size_t size, bool &in_sync,
+                            uint64_t &discarded_bytes, OnFrame &&on_frame, OnCrcError &&on_crc_error) {
+        FrameView frame;
+        size_t begin = 0;
+        while (begin < size) {
+            const uint8_t *data = block + begin;
+            const size_t available = size - begin;
+            auto status = scanner.parse(data, available, frame);
+            if (status == FrameScanner::Status::INCOMPLETE) {
+                break;
+            } else if (status == FrameScanner::Status::VALID) {
+                on_frame(frame);
+                begin += frame.size;
+                in_sync = true;
+                continue;
+            } else if (status == FrameScanner::Status::BAD_CRC && in_sync) {
+                on_crc_error(frame);
+            }
+            // resynchronize on the next magic byte
+            in_sync = false;
+            const size_t skip = findMagic(data, 1, available);
+            discarded_bytes += skip;
+            begin += skip;
+        }
+        return begin;
+    }
+
+    /**
+     * Like scanBlock(), for a block that is complete by itself. Frames never continue past its end, so an
+     * incomplete frame is a false magic byte or a truncated frame, and scanning resynchronizes after it.
+     * Everything outside of valid frames is counted in discarded_bytes.
+     */
+    template<typename OnFrame, typename OnCrcError>
+    static void scanToEnd(FrameScanner &scanner, const uint8_t *block, size_t size, bool &in_sync,
+                          uint64_t &discarded_bytes, OnFrame &&on_frame, OnCrcError &&on_crc_error) {
+        size_t begin = 0;
+        while (begin < size) {
+            begin += scanBlock(scanner, block + begin, size - begin, in_sync, discarded_bytes, on_frame, on_crc_error);
+            if (begin < size) {
+                in_sync = false;
+                const size_t skip = findMagic(block + begin, 1, size - begin);
+                discarded_bytes += skip;
+                begin += skip;
+            }
+        }
+    }
+
+    /**
+     * Frames a datagram, where a frame is expected at the start and frames never continue in the next one.
+     */
+    template<typename OnFrame, typename OnCrcError>
+    static void scanDatagram(FrameScanner &scanner, const uint8_t *block, size_t size, uint64_t &discarded_bytes,
+                             OnFrame &&on_frame, OnCrcError &&on_crc_error) {
+        bool in_sync = true;
+        scanToEnd(scanner, block, size, in_sync, discarded_bytes, on_frame, on_crc_error);
+    }
+
+    /**
+     * Calls on_frame(frame) for every complete, valid frame in the received data, and
+     * on_crc_error(frame) for frames with a bad checksum where a frame was expected.
+     * The views are only valid during the call.
+     */
+    template<typename OnFrame, typename OnCrcError>
+    void scan(OnFrame &&on_frame, OnCrcError &&on_crc_error) {
+        _begin += scanBlock(_scanner, _buffer.data() + _begin, _end - _begin, _in_sync, _discarded_bytes,
+                            on_frame, on_crc_error);
+    }
+
+    /**
+     * Frames what is left at the end of the stream. No more data will complete an incomplete frame, so the
+     * frames behind it are still found.
+     */
+    template<typename OnFrame, typename OnCrcError>
+    void finish(OnFrame &&on_frame, OnCrcError &&on_crc_error) {
+        scanToEnd(_scanner, _buffer.data() + _begin, _end - _begin, _in_sync, _discarded_bytes,
+                  on_frame, on_crc_error);
+        _begin = _end;
+    }
+
+    /**
+     * @return bytes skipped while searching for frames
+     */
+    [[nodiscard]] uint64_t discardedBytes() const {
+        return _discarded_bytes;
+    }
+};
+
+#endif //MAVTOOLS_STREAMSCANNER_H
@@ -0,0 +1,122 @@
+/****************************************************************************
+ *
+ * Copyright (c) 2024, libmav development team
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name libmav nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+#ifndef MAVTOOLS_TLOG_H
+#define MAVTOOLS_TLOG_H
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+
+#include "Frame.h"
+
+/**
+ * The tlog capture format, as written by QGroundControl and MAVProxy: every frame is preceded by the time
+ * it was received, as big-endian microseconds since the Unix epoch.
+ */
+static constexpr size_t TLOG_TIMESTAMP_SIZE = 8;
+
+/**
+ * @return the current wall clock time in microseconds since the Unix epoch
+ */
+inline uint64_t wallClockMicros() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+inline std::array<char, TLOG_TIMESTAMP_SIZE> encodeTlogTimestamp(uint64_t timestamp_us) {
+    std::array<char, TLOG_TIMESTAMP_SIZE> bytes{};
+    for (size_t i = 0; i < TLOG_TIMESTAMP_SIZE; i++) {
+        bytes[i] = static_cast<char>(timestamp_us >> (8 * (TLOG_TIMESTAMP_SIZE - 1 - i)));
+    }
+    return bytes;
+}
+
+inline uint64_t decodeTlogTimestamp(const uint8_t *data) {
+    uint64_t timestamp_us = 0;
+    for (size_t i = 0; i < TLOG_TIMESTAMP_SIZE; i++) {
+        timestamp_us = (timestamp_us << 8) | data[i];
+    }
+    return timestamp_us;
+}
+
+/**
+ * Calls on_record(timestamp_us, frame) for every timestamped frame in a block of tlog data.
+ * After an invalid record, the search continues a timestamp before the next magic byte.
+ * @return the number of bytes consumed, up to an incomplete record
+ */
+template<typename OnRecord>
+size_t scanTlogBlock(FrameScanner &scanner, const uint8_t *block, size_t size, uint64_t &discarded_bytes,
+                     OnRecord &&on_record) {
+    FrameView frame;
+    size_t begin = 0;
+    while (size - begin > TLOG_TIMESTAMP_SIZE) {
+        const uint8_t *record = block + begin;
+        auto status = scanner.parse(record + TLOG_TIMESTAMP_SIZE, size - begin - TLOG_TIMESTAMP_SIZE, frame);
+        if (status == FrameScanner::Status::INCOMPLETE) {
+            break;
+        } else if (status == FrameScanner::Status::VALID) {
+            on_record(decodeTlogTimestamp(record), frame);
+            begin += TLOG_TIMESTAMP_SIZE + frame.size;
+        } else {
+            // the next record can only start a timestamp before the next magic byte
+            const size_t next = findMagic(block, begin + TLOG_TIMESTAMP_SIZE + 1, size) - TLOG_TIMESTAMP_SIZE;
+            discarded_bytes += next - begin;
+            begin = next;
+        }
+    }
+    return begin;
+}
+
+/**
+ * Like scanTlogBlock(), for the last block of a capture. An incomplete record can not be completed any more,
+ * so it is skipped like an invalid one, and all remaining bytes are consumed.
+ */
+template<typename OnRecord>
+void scanTlogEnd(FrameScanner &scanner, const uint8_t *block, size_t size, uint64_t &discarded_bytes,
+                 OnRecord &&on_record) {
+    size_t begin = 0;
+    while (true) {
+        begin += scanTlogBlock(scanner, block + begin, size - begin, discarded_bytes, on_record);
+        if (size - begin <= TLOG_TIMESTAMP_SIZE) {
+            break;
+        }
+        const size_t next = findMagic(block, begin + TLOG_TIMESTAMP_SIZE + 1, size) - TLOG_TIMESTAMP_SIZE;
+        discarded_bytes += next - begin;
+        begin = next;
+    }
+    discarded_bytes += size - begin;
+}
+
+#endif //MAVTOOLS_TLOG_H
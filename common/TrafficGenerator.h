@@ -0,0 +1,251 @@
+/****************************************************************************
+ *
+ * Copyright (c) 2024, libmav development team
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name libmav nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+#ifndef MAVTOOLS_TRAFFICGENERATOR_H
+#define MAVTOOLS_TRAFFICGENERATOR_H
+
+#include <array>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "mav/MessageSet.h"
+#include "MessagePlan.h"
+
+/**
+ * One message type of a synthetic traffic profile.
+ */
+struct TrafficStream {
+    int message_id;
+    double rate;            // messages per second
+    uint8_t system_id = 1;
+    uint8_t component_id = 1;
+};
+
+/**
+ * Parses a traffic profile. Entries are separated by commas or newlines, and look like NAME=Hz or NAME=Hz@sysid:compid,
+ * where NAME is a message name or id. Everything after a # on a line is a comment.
+ * @throws std::invalid_argument if the profile can not be parsed
+ */
+inline std::vector<TrafficStream> parseTrafficProfile(const std::string &profile, const mav::MessageSet &message_set) {
+    auto parseNumber = [](const std::string &text, double max, const std::string &entry) {
+        size_t parsed = 0;
+        double value = -1;
+        try {
+            value = std::stod(text, &parsed);
+        } catch (std::logic_error &) {
+            parsed = 0;
+        }
+        if (parsed == 0 || parsed != text.size() || !(value >= 0) || value > max) {
+            throw std::invalid_argument("Invalid profile entry: " + entry);
+        }
+        return value;
+    };
+
+    std::vector<TrafficStream> streams;
+    size_t start = 0;
+    while (start < profile.size()) {
+        size_t end = profile.find_first_of(",\n", start);
+        if (end == std::string::npos) {
+            end = profile.size();
+        }
+        std::string entry = profile.substr(start, end - start);
+        start = end + 1;
+        entry = entry.substr(0, entry.find('#'));
+        entry.erase(0, entry.find_first_not_of(" \t\r"));
+        entry.erase(entry.find_last_not_of(" \t\r") + 1);
+        if (entry.empty()) {
+            continue;
+        }
+
+        const size_t equals = entry.find('=');
+        if (equals == std::string::npos) {
+            throw std::invalid_argument("Expected NAME=Hz, got: " + entry);
+        }
+        const std::string name = entry.substr(0, equals);
+        const size_t at = entry.find('@', equals);
+        TrafficStream stream{0, parseNumber(entry.substr(equals + 1, at - equals - 1), 1e9, entry)};
+        if (stream.rate <= 0) {
+            throw std::invalid_argument("Rate must be positive: " + entry);
+        }
+        if (at != std::string::npos) {
+            const size_t colon = entry.find(':', at);
+            if (colon == std::string::npos) {
+                throw std::invalid_argument("Expected @sysid:compid, got: " + entry);
+            }
+            stream.system_id = static_cast<uint8_t>(parseNumber(entry.substr(at + 1, colon - at - 1), 255, entry));
+            stream.component_id = static_cast<uint8_t>(parseNumber(entry.substr(colon + 1), 255, entry));
+        }
+
+        auto definition = message_set.getMessageDefinition(name);
+        if (definition.has_value()) {
+            stream.message_id = definition.get().id();
+        } else {
+            try {
+                stream.message_id = static_cast<int>(parseNumber(name, 0xFFFFFF, entry));
+            } catch (std::invalid_argument &) {
+                stream.message_id = -1;
+            }
+            if (stream.message_id < 0 || !message_set.contains(stream.message_id)) {
+                throw std::invalid_argument("Unknown message: " + name);
+            }
+        }
+        streams.push_back(stream);
+    }
+    if (streams.empty()) {
+        throw std::invalid_argument("Empty traffic profile");
+    }
+    return streams;
+}
+
+/**
+ * splitmix64, so that synthetic traffic is the same on every platform and standard library.
+ */
+class SplitMix64 {
+private:
+    uint64_t _state;
+
+public:
+    explicit SplitMix64(uint64_t seed) : _state(seed) {}
+
+    uint64_t next() {
+        uint64_t z = (_state += 0x9E3779B97F4A7C15ULL);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        return z ^ (z >> 31);
+    }
+
+    /**
+     * @return a uniformly distributed value in [0, 1)
+     */
+    double uniform() {
+        return static_cast<double>(next() >> 11) * 0x1.0p-53;
+    }
+};
+
+/**
+ * Generates the frames of a traffic profile, interleaved according to their rates, through the same
+ * MessageSet / finalize path as mavencode. Field values are pseudo-random, but deterministic for a seed.
+ */
+class TrafficGenerator {
+private:
+    struct FieldInfo {
+        std::string name;
+        mav::FieldType::BaseType type;
+        int count;
+    };
+
+    struct Stream {
+        TrafficStream config;
+        mav::Message message_template;
+        std::vector<FieldInfo> fields;
+        double next_time;
+    };
+
+    SplitMix64 _random;
+    std::vector<Stream> _streams;
+    // next sequence number per sender, indexed by system_id << 8 | component_id
+    std::array<uint8_t, 65536> _sequence{};
+    std::string _string_value;
+
+    void randomize(mav::Message &message, const std::vector<FieldInfo> &fields) {
+        for (const auto &field : fields) {
+            if (field.type == mav::FieldType::BaseType::CHAR) {
+                _string_value.resize(_random.next() % (field.count + 1));
+                for (auto &c : _string_value) {
+                    c = static_cast<char>('a' + _random.next() % 26);
+                }
+                message.set(field.name, _string_value);
+                continue;
+            }
+            dispatchBaseType(field.type, [&](auto tag) {
+                using T = typename decltype(tag)::type;
+                for (int i = 0; i < field.count; i++) {
+                    T value;
+                    if constexpr (std::is_floating_point_v<T>) {
+                        value = static_cast<T>((_random.uniform() * 2.0 - 1.0) * 1000.0);
+                    } else {
+                        value = static_cast<T>(_random.next());
+                    }
+                    message.set(field.name, value, i);
+                }
+            });
+        }
+    }
+
+public:
+    TrafficGenerator(const mav::MessageSet &message_set, const std::vector<TrafficStream> &streams, uint64_t seed) :
+            _random(seed) {
+        for (const auto &config : streams) {
+            auto message = message_set.create(config.message_id);
+            std::vector<FieldInfo> fields;
+            for (const auto &name : message.type().fieldNames()) {
+                const auto &field = message.type().fieldForName(name);
+                fields.push_back({name, field.type.base_type, field.type.size});
+            }
+            // spread out the first messages of each stream over one period
+            double phase = _random.uniform() / config.rate;
+            _streams.push_back({config, std::move(message), std::move(fields), phase});
+        }
+    }
+
+    /**
+     * Appends the next frame to out.
+     * @return the time in seconds since the start of the traffic at which the frame is due
+     */
+    double next(std::string &out) {
+        Stream *stream = &_streams.front();
+        for (auto &candidate : _streams) {
+            if (candidate.next_time < stream->next_time) {
+                stream = &candidate;
+            }
+        }
+        const double time = stream->next_time;
+        stream->next_time += 1.0 / stream->config.rate;
+
+        mav::Message message = stream->message_template;
+        randomize(message, stream->fields);
+        const auto &config = stream->config;
+        message.header().systemId() = config.system_id;
+        message.header().componentId() = config.component_id;
+        uint8_t &seq = _sequence[config.system_id << 8 | config.component_id];
+        int len = message.finalize(seq++, {config.system_id, config.component_id});
+        out.append(reinterpret_cast<const char *>(message.data()), len);
+        return time;
+    }
+};
+
+#endif //MAVTOOLS_TRAFFICGENERATOR_H
@@ -38,7 +38,12 @@
 #include "incbin/incbin.h"
 #include "mav/MessageSet.h"
 
+#ifdef MAVTOOLS_MESSAGE_DEFINITIONS_DIR
+// minified copies of the dialect XMLs, generated at build time and still parsed by libmav at startup
+#define MAVLINK_BASE MAVTOOLS_MESSAGE_DEFINITIONS_DIR
+#else
 #define MAVLINK_BASE "../dependencies/mavlink/message_definitions/v1.0/"
+#endif
 
 INCBIN(common, MAVLINK_BASE"common.xml");
 INCBIN(development, MAVLINK_BASE"development.xml");
@@ -0,0 +1,512 @@
+/****************************************************************************
+ *
+ * Copyright (c) 2024, libmav development team
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name libmav nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+#ifndef MAVTOOLS_CAPTUREINDEX_H
+#define MAVTOOLS_CAPTUREINDEX_H
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "../common/Frame.h"
+#include "../common/MappedFile.h"
+#include "../common/MessagePlan.h"
+
+/**
+ * Reads the boot time of frames from their time_boot_ms field, or from time_usec for messages without it.
+ * time_usec values that look like Unix time rather than time since boot are ignored.
+ */
+class FrameClock {
+public:
+    static constexpr int64_t NO_TIME = -1;
+
+private:
+    // 10^15 us is about 31 years, Unix time has been past that since 2001
+    static constexpr uint64_t MAX_BOOT_TIME_US = 1000000000000000ULL;
+
+    struct TimeField {
+        int offset = -1;    // -1 for messages without a time field
+        bool usec = false;
+    };
+
+    const mav::MessageSet &_message_set;
+    std::unordered_map<uint32_t, TimeField> _fields;
+    PayloadBuffer _payload_buffer;
+
+    TimeField _lookup(uint32_t message_id) const {
+        TimeField field;
+        auto definition = _message_set.getMessageDefinition(static_cast<int>(message_id));
+        if (!definition.has_value()) {
+            return field;
+        }
+        if (definition.get().containsField("time_boot_ms") &&
+                definition.get().fieldForName("time_boot_ms").type.base_type == mav::FieldType::BaseType::UINT32) {
+            field.offset = definition.get().fieldForName("time_boot_ms").offset;
+        } else if (definition.get().containsField("time_usec") &&
+                definition.get().fieldForName("time_usec").type.base_type == mav::FieldType::BaseType::UINT64) {
+            field.offset = definition.get().fieldForName("time_usec").offset;
+            field.usec = true;
+        }
+        return field;
+    }
+
+public:
+    explicit FrameClock(const mav::MessageSet &message_set) : _message_set(message_set) {}
+
+    /**
+     * @return the boot time in milliseconds, or NO_TIME
+     */
+    int64_t timeMs(const FrameView &frame) {
+        auto it = _fields.find(frame.message_id);
+        if (it == _fields.end()) {
+            it = _fields.emplace(frame.message_id, _lookup(frame.message_id)).first;
+        }
+        const TimeField &field = it->second;
+        if (field.offset < 0) {
+            return NO_TIME;
+        }
+        const size_t size = field.usec ? sizeof(uint64_t) : sizeof(uint32_t);
+        const uint8_t *payload = _payload_buffer.extend(frame.payload(), frame.payload_length, field.offset + size);
+        if (!field.usec) {
+            return readPayloadValue<uint32_t>(payload, field.offset);
+        }
+        const auto time_us = readPayloadValue<uint64_t>(payload, field.offset);
+        return time_us < MAX_BOOT_TIME_US ? static_cast<int64_t>(time_us / 1000) : NO_TIME;
+    }
+};
+
+/**
+ * Sidecar index of a capture file, for seeking to message types and time ranges without a full pass.
+ *
+ * The capture is cut into blocks of a fixed number of frames, starting at the offset of their first frame.
+ * Every block knows the boot time at its start and the range of boot times within it, where the time of
+ * a frame without time field is the last time seen before it. Every message id has the runs of blocks it
+ * occurs in. The index is stored little endian, next to the capture with an .idx suffix:
+ *
+ *   magic "MAVIDX01", uint64 capture size, int64 capture mtime in ns, uint32 frames per block,
+ *   uint64 frame count, uint64 block count, per block: uint64 offset, int64 start, min and max time in ms,
+ *   uint32 message id count, per message id: uint32 id, uint32 run count, per run: uint32 first and last block
+ */
+class CaptureIndex {
+public:
+    struct Block {
+        uint64_t offset;
+        int64_t start_time;
+        int64_t min_time;
+        int64_t max_time;
+    };
+
+    struct Run {
+        uint32_t first;
+        uint32_t last;
+    };
+
+    /**
+     * Frames starting in [begin, end), with the boot time before the first of them.
+     */
+    struct Region {
+        uint64_t begin;
+        uint64_t end;
+        int64_t start_time;
+    };
+
+    static constexpr char MAGIC[] = "MAVIDX01";
+
+private:
+    uint32_t _interval;
+    uint64_t _capture_size = 0;
+    int64_t _capture_mtime = 0;
+    uint64_t _frames = 0;
+    int64_t _time = FrameClock::NO_TIME;
+    std::vector<Block> _blocks;
+    std::unordered_map<uint32_t, std::vector<Run>> _runs;
+
+    template<typename T>
+    static void _put(std::string &buffer, T value) {
+        for (size_t i = 0; i < sizeof(T); i++) {
+            buffer.push_back(static_cast<char>(static_cast<uint64_t>(value) >> (8 * i)));
+        }
+    }
+
+    template<typename T>
+    static T _get(const uint8_t *&position, const uint8_t *end) {
+        if (static_cast<size_t>(end - position) < sizeof(T)) {
+            throw std::runtime_error("Truncated capture index");
+        }
+        uint64_t value = 0;
+        for (size_t i = 0; i < sizeof(T); i++) {
+            value |= static_cast<uint64_t>(position[i]) << (8 * i);
+        }
+        position += sizeof(T);
+        return static_cast<T>(value);
+    }
+
+    static std::pair<uint64_t, int64_t> _stat(const std::string &capture) {
+        struct stat file_stat{};
+        if (::stat(capture.c_str(), &file_stat) != 0) {
+            throw std::runtime_error("Could not stat " + capture + ": " + std::strerror(errno));
+        }
+        return {static_cast<uint64_t>(file_stat.st_size),
+                static_cast<int64_t>(file_stat.st_mtim.tv_sec) * 1000000000 + file_stat.st_mtim.tv_nsec};
+    }
+
+public:
+    explicit CaptureIndex(uint32_t interval = 4096) : _interval(std::max<uint32_t>(interval, 1)) {}
+
+    static std::string pathFor(const std::string &capture) {
+        return capture + ".idx";
+    }
+
+    /**
+     * Adds the next frame of the capture, while building the index.
+     */
+    void append(uint64_t offset, uint32_t message_id, int64_t time_ms) {
+        if (_frames % _interval == 0) {
+            _blocks.push_back({offset, _time, FrameClock::NO_TIME, FrameClock::NO_TIME});
+        }
+        _frames++;
+        Block &block = _blocks.back();
+        if (time_ms != FrameClock::NO_TIME) {
+            _time = time_ms;
+        }
+        if (_time != FrameClock::NO_TIME) {
+            block.min_time = block.min_time == FrameClock::NO_TIME ? _time : std::min(block.min_time, _time);
+            block.max_time = std::max(block.max_time, _time);
+        }
+        const auto block_index = static_cast<uint32_t>(_blocks.size() - 1);
+        auto &runs = _runs[message_id];
+        if (runs.empty() || runs.back().last + 1 < block_index) {
+            runs.push_back({block_index, block_index});
+        } else {
+            runs.back().last = block_index;
+        }
+    }
+
+    /**
+     * Ends building the index, the last block ends at the end of the capture.
+     */
+    void finish(uint64_t capture_size) {
+        _capture_size = capture_size;
+    }
+
+    [[nodiscard]] uint64_t frames() const {
+        return _frames;
+    }
+
+    [[nodiscard]] const std::vector<Block> &blocks() const {
+        return _blocks;
+    }
+
+    /**
+     * @return the maximum time of the last block with a time, or NO_TIME
+     */
+    [[nodiscard]] int64_t lastTime() const {
+        for (auto it = _blocks.rbegin(); it != _blocks.rend(); ++it) {
+            if (it->max_time != FrameClock::NO_TIME) {
+                return it->max_time;
+            }
+        }
+        return FrameClock::NO_TIME;
+    }
+
+    /**
+     * @param message_ids only blocks containing one of them, or all blocks if empty
+     * @param from_ms, to_ms only blocks with times overlapping [from_ms, to_ms], if set
+     * @return the selected blocks, adjacent ones merged into one region
+     */
+    [[nodiscard]] std::vector<Region> select(const std::vector<uint32_t> &message_ids,
+                                             std::optional<int64_t> from_ms, std::optional<int64_t> to_ms) const {
+        std::vector<bool> selected(_blocks.size(), message_ids.empty());
+        for (uint32_t id : message_ids) {
+            auto it = _runs.find(id);
+            if (it == _runs.end()) {
+                continue;
+            }
+            for (const auto &run : it->second) {
+                std::fill(selected.begin() + run.first, selected.begin() + run.last + 1, true);
+            }
+        }
+        std::vector<Region> regions;
+        for (size_t i = 0; i < _blocks.size(); i++) {
+            const Block &block = _blocks[i];
+            if (from_ms || to_ms) {
+                selected[i] = selected[i] && block.max_time != FrameClock::NO_TIME &&
+                        (!from_ms || block.max_time >= *from_ms) && (!to_ms || block.min_time <= *to_ms);
+            }
+            if (!selected[i]) {
+                continue;
+            }
+            const uint64_t end = i + 1 < _blocks.size() ? _blocks[i + 1].offset : _capture_size;
+            if (!regions.empty() && regions.back().end == block.offset) {
+                regions.back().end = end;
+            } else {
+                regions.push_back({block.offset, end, block.start_time});
+            }
+        }
+        return regions;
+    }
+
+    void save(const std::string &capture) {
+        std::tie(_capture_size, _capture_mtime) = _stat(capture);
+        std::string buffer{MAGIC, sizeof(MAGIC) - 1};
+        _put(buffer, _capture_size);
+        _put(buffer, _capture_mtime);
+        _put(buffer, _interval);
+        _put(buffer, _frames);
+        _put(buffer, static_cast<uint64_t>(_blocks.size()));
+        for (const auto &block : _blocks) {
+            _put(buffer, block.offset);
+            _put(buffer, block.start_time);
+            _put(buffer, block.min_time);
+            _put(buffer, block.max_time);
+        }
+        _put(buffer, static_cast<uint32_t>(_runs.size()));
+        for (const auto &[id, runs] : _runs) {
+            _put(buffer, id);
+            _put(buffer, static_cast<uint32_t>(runs.size()));
+            for (const auto &run : runs) {
+                _put(buffer, run.first);
+                _put(buffer, run.last);
+            }
+        }
+
+        const std::string path = pathFor(capture);
+        int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) {
+            throw std::runtime_error("Could not open " + path + ": " + std::strerror(errno));
+        }
+        std::string_view data{buffer};
+        while (!data.empty()) {
+            ssize_t res = ::write(fd, data.data(), data.size());
+            if (res < 0 && errno == EINTR) {
+                continue;
+            } else if (res < 0) {
+                ::close(fd);
+                throw std::runtime_error("Error writing " + path + ": " + std::strerror(errno));
+            }
+            data.remove_prefix(static_cast<size_t>(res));
+        }
+        ::close(fd);
+    }
+
+    /**
+     * @throws std::runtime_error if there is no valid index, or the capture changed since it was built
+     */
+    static CaptureIndex load(const std::string &capture) {
+        const std::string path = pathFor(capture);
+        if (!MappedFile::isRegularFile(path)) {
+            throw std::runtime_error("No index for " + capture + ", create one with --build-index");
+        }
+        MappedFile file{path};
+        const uint8_t *position = file.data();
+        const uint8_t *end = file.data() + file.size();
+        if (file.size() < sizeof(MAGIC) - 1 || std::memcmp(position, MAGIC, sizeof(MAGIC) - 1) != 0) {
+            throw std::runtime_error(path + " is not a capture index");
+        }
+        position += sizeof(MAGIC) - 1;
+
+        CaptureIndex index;
+        index._capture_size = _get<uint64_t>(position, end);
+        index._capture_mtime = _get<int64_t>(position, end);
+        if (std::make_pair(index._capture_size, index._capture_mtime) != _stat(capture)) {
+            throw std::runtime_error(path + " is out of date, rebuild it with --build-index");
+        }
+        index._interval = _get<uint32_t>(position, end);
+        index._frames = _get<uint64_t>(position, end);
+        const auto block_count = _get<uint64_t>(position, end);
+        index._blocks.reserve(std::min<uint64_t>(block_count, file.size() / 32));
+        for (uint64_t i = 0; i < block_count; i++) {
+            Block block{};
+            block.offset = _get<uint64_t>(position, end);
+            block.start_time = _get<int64_t>(position, end);
+            block.min_time = _get<int64_t>(position, end);
+            block.max_time = _get<int64_t>(position, end);
+            index._blocks.push_back(block);
+        }
+        const auto id_count = _get<uint32_t>(position, end);
+        for (uint32_t i = 0; i < id_count; i++) {
+            auto &runs = index._runs[_get<uint32_t>(position, end)];
+            const auto run_count = _get<uint32_t>(position, end);
+            for (uint32_t j = 0; j < run_count; j++) {
+                Run run{};
+                run.first = _get<uint32_t>(position, end);
+                run.last = _get<uint32_t>(position, end);
+                if (run.first > run.last || run.last >= index._blocks.size()) {
+                    throw std::runtime_error(path + " is corrupt");
+                }
+                runs.push_back(run);
+            }
+        }
+        return index;
+    }
+};
+
+/**
+ * Builds a CaptureIndex in one pass over an in-memory capture, scanning chunks on a pool of worker threads.
+ * Chunks are stitched like in ParallelFileDecoder: frames starting inside the previous chunk's last frame are
+ * dropped, and a chunk that synchronized onto a false frame is scanned again sequentially.
+ */
+class IndexBuilder {
+private:
+    static constexpr size_t DEFAULT_CHUNK_SIZE = 4 * 1024 * 1024;
+    // maximum number of scanned chunks waiting to be added, per thread
+    static constexpr size_t WINDOW_PER_THREAD = 2;
+
+    struct IndexedFrame {
+        uint64_t offset;
+        uint64_t end;
+        uint32_t message_id;
+        int64_t time_ms;
+    };
+
+    const mav::MessageSet &_message_set;
+    const int _threads;
+    const size_t _chunk_size;
+
+    static std::vector<IndexedFrame> _scan(FrameScanner &scanner, FrameClock &clock, const uint8_t *data,
+                                           size_t from, size_t end, size_t limit) {
+        std::vector<IndexedFrame> frames;
+        FrameView frame;
+        size_t offset = from;
+        while ((offset = scanner.find(data, offset, end, limit, frame)) < end) {
+            frames.push_back({offset, offset + frame.size, frame.message_id, clock.timeMs(frame)});
+            offset += frame.size;
+        }
+        return frames;
+    }
+
+public:
+    IndexBuilder(const mav::MessageSet &message_set, int threads, size_t chunk_size = DEFAULT_CHUNK_SIZE) :
+            _message_set(message_set), _threads(std::max(threads, 1)), _chunk_size(std::max<size_t>(chunk_size, 1)) {}
+
+    void build(const uint8_t *data, size_t size, CaptureIndex &index, const std::atomic_bool &interrupted) {
+        const size_t chunk_count = (size + _chunk_size - 1) / _chunk_size;
+        const size_t window = _threads * WINDOW_PER_THREAD;
+        std::vector<std::optional<std::vector<IndexedFrame>>> chunks(chunk_count);
+        size_t next_chunk = 0;
+        size_t added_chunks = 0;
+        std::mutex mutex;
+        std::condition_variable cv;
+
+        auto worker = [&] {
+            FrameScanner scanner{_message_set};
+            FrameClock clock{_message_set};
+            std::unique_lock<std::mutex> lock(mutex);
+            while (true) {
+                cv.wait(lock, [&] {
+                    return next_chunk >= chunk_count || next_chunk < added_chunks + window || interrupted.load();
+                });
+                if (next_chunk >= chunk_count || interrupted.load()) {
+                    return;
+                }
+                const size_t chunk = next_chunk++;
+                lock.unlock();
+                const size_t from = chunk * _chunk_size;
+                auto frames = _scan(scanner, clock, data, from, std::min(from + _chunk_size, size), size);
+                lock.lock();
+                chunks[chunk] = std::move(frames);
+                cv.notify_all();
+            }
+        };
+        std::vector<std::thread> workers;
+        for (int i = 0; i < _threads; i++) {
+            workers.emplace_back(worker);
+        }
+
+        FrameScanner stitch_scanner{_message_set};
+        FrameClock stitch_clock{_message_set};
+        size_t position = 0;
+        for (size_t chunk = 0; chunk < chunk_count && !interrupted.load(); chunk++) {
+            std::vector<IndexedFrame> frames;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                while (!chunks[chunk].has_value() && !interrupted.load()) {
+                    cv.wait_for(lock, std::chrono::milliseconds(100));
+                }
+                if (!chunks[chunk].has_value()) {
+                    break;
+                }
+                frames = std::move(*chunks[chunk]);
+                chunks[chunk].reset();
+            }
+            size_t first_kept = 0;
+            while (first_kept < frames.size() && frames[first_kept].offset < position) {
+                first_kept++;
+            }
+            if (first_kept > 0 && frames[first_kept - 1].end > position) {
+                frames = _scan(stitch_scanner, stitch_clock, data, position,
+                               std::min((chunk + 1) * _chunk_size, size), size);
+                first_kept = 0;
+            }
+            for (size_t i = first_kept; i < frames.size(); i++) {
+                index.append(frames[i].offset, frames[i].message_id, frames[i].time_ms);
+            }
+            if (first_kept < frames.size()) {
+                position = frames.back().end;
+            }
+
+            std::lock_guard<std::mutex> lock(mutex);
+            added_chunks = chunk + 1;
+            cv.notify_all();
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            next_chunk = chunk_count;
+            cv.notify_all();
+        }
+        for (auto &thread : workers) {
+            thread.join();
+        }
+        index.finish(size);
+    }
+};
+
+#endif //MAVTOOLS_CAPTUREINDEX_H
@@ -0,0 +1,231 @@
+/****************************************************************************
+ *
+ * Copyright (c) 2024, libmav development team
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name libmav nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+#ifndef MAVTOOLS_COLUMNEXPORT_H
+#define MAVTOOLS_COLUMNEXPORT_H
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "../common/BinaryWriter.h"
+#include "DecodeOptions.h"
+#include "Demultiplexer.h"
+
+/**
+ * Collects the fields of every message type into typed column buffers, and writes them out in batches of
+ * bounded size, so memory does not grow with the length of the input. Each message type goes to its own
+ * output of a Demultiplexer split by message, in this layout, with all numbers little endian:
+ *
+ *   file:   magic "MAVCOLS1", header, then batches until the end of the file
+ *   header: uint32 message id, uint16 name length, name, uint16 column count, then per column:
+ *           uint8 type, uint16 elements per row, uint16 name length, name
+ *   batch:  uint32 row count, then per column in header order: row count × elements values
+ *
+ * Column types are the typed array codes of the binary output formats, 0 uint8, 5 uint16, 6 uint32, 7 uint64,
+ * 8 int8, 13 int16, 14 int32, 15 int64, 21 float and 22 double, plus 128 for char arrays, which are text of
+ * elements bytes, zero terminated unless it fills all of them. The first columns are system_id, component_id and seq, and timestamp_us with
+ * timestamps, followed by the fields in plan order.
+ */
+class ColumnExporter {
+public:
+    static constexpr char MAGIC[] = "MAVCOLS1";
+    static constexpr uint8_t TEXT_COLUMN = 128;
+
+private:
+    // target size of one batch, for all columns of a message type together
+    static constexpr size_t BATCH_SIZE = 1024 * 1024;
+
+    enum class Source {
+        SYSTEM_ID,
+        COMPONENT_ID,
+        SEQ,
+        TIMESTAMP,
+        FIELD
+    };
+
+    struct Column {
+        std::string name;
+        Source source;
+        uint8_t type;
+        uint16_t count;     // elements per row
+        int offset;         // in the payload, for fields
+        size_t width;       // bytes per row
+        std::string data;
+    };
+
+    struct Table {
+        const MessagePlan *plan;
+        std::vector<Column> columns;
+        size_t rows = 0;
+        size_t capacity = 0;
+        bool started = false;
+    };
+
+    const DecodeOptions &_options;
+    Demultiplexer &_output;
+    MessagePlanCache _plans;
+    PayloadBuffer _payload_buffer;
+    std::unordered_map<uint32_t, std::unique_ptr<Table>> _tables;
+    std::string _batch;
+
+    template<typename T>
+    static void _append(std::string &buffer, T value) {
+        for (size_t i = 0; i < sizeof(T); i++) {
+            buffer.push_back(static_cast<char>(static_cast<uint64_t>(value) >> (8 * i)));
+        }
+    }
+
+    static void _appendName(std::string &buffer, std::string_view name) {
+        _append(buffer, static_cast<uint16_t>(name.size()));
+        buffer.append(name);
+    }
+
+    std::unique_ptr<Table> _table(const MessagePlan &plan) {
+        auto table = std::make_unique<Table>();
+        table->plan = &plan;
+        table->columns.push_back({"system_id", Source::SYSTEM_ID, TypedArrayCode::UINT8, 1, 0, 1, {}});
+        table->columns.push_back({"component_id", Source::COMPONENT_ID, TypedArrayCode::UINT8, 1, 0, 1, {}});
+        table->columns.push_back({"seq", Source::SEQ, TypedArrayCode::UINT8, 1, 0, 1, {}});
+        if (_options.timestamps) {
+            table->columns.push_back({"timestamp_us", Source::TIMESTAMP, TypedArrayCode::UINT64, 1, 0, 8, {}});
+        }
+        for (const auto &field : plan.fields) {
+            uint8_t type = TEXT_COLUMN;
+            size_t size = 1;
+            dispatchBaseType(field.type, [&type, &size](auto tag) {
+                using T = typename decltype(tag)::type;
+                size = sizeof(T);
+                if constexpr (!std::is_same_v<T, char>) {
+                    type = TypedArrayCode::of<T>();
+                }
+            });
+            table->columns.push_back({field.name, Source::FIELD, type, static_cast<uint16_t>(field.count), field.offset,
+                                      size * field.count, {}});
+        }
+        size_t row_width = 0;
+        for (const auto &column : table->columns) {
+            row_width += column.width;
+        }
+        table->capacity = std::max<size_t>(BATCH_SIZE / row_width, 1);
+        for (auto &column : table->columns) {
+            column.data.reserve(table->capacity * column.width);
+        }
+        return table;
+    }
+
+    void _flush(uint32_t message_id, Table &table) {
+        _batch.clear();
+        if (!table.started) {
+            _batch.append(MAGIC, sizeof(MAGIC) - 1);
+            _append(_batch, message_id);
+            _appendName(_batch, table.plan->definition->name());
+            _append(_batch, static_cast<uint16_t>(table.columns.size()));
+            for (const auto &column : table.columns) {
+                _append(_batch, column.type);
+                _append(_batch, column.count);
+                _appendName(_batch, column.name);
+            }
+            table.started = true;
+        }
+        _append(_batch, static_cast<uint32_t>(table.rows));
+        for (auto &column : table.columns) {
+            _batch.append(column.data);
+            column.data.clear();
+        }
+        table.rows = 0;
+        _output.write(message_id, _batch);
+    }
+
+public:
+    /**
+     * @param output split by message
+     */
+    ColumnExporter(const DecodeOptions &options, Demultiplexer &output) :
+            _options(options), _output(output), _plans(options.message_set, &options.projection) {}
+
+    void add(const FrameView &frame, uint64_t timestamp_us = 0) {
+        auto it = _tables.find(frame.message_id);
+        if (it == _tables.end()) {
+            const MessagePlan *plan = _plans.get(frame.message_id);
+            it = _tables.emplace(frame.message_id, plan ? _table(*plan) : nullptr).first;
+        }
+        Table *table = it->second.get();
+        if (!table) {
+            return;
+        }
+        const uint8_t *payload = _payload_buffer.extend(frame.payload(), frame.payload_length,
+                                                        table->plan->payload_size);
+        for (auto &column : table->columns) {
+            switch (column.source) {
+                case Source::SYSTEM_ID:
+                    column.data.push_back(static_cast<char>(frame.system_id));
+                    break;
+                case Source::COMPONENT_ID:
+                    column.data.push_back(static_cast<char>(frame.component_id));
+                    break;
+                case Source::SEQ:
+                    column.data.push_back(static_cast<char>(frame.seq));
+                    break;
+                case Source::TIMESTAMP:
+                    _append(column.data, timestamp_us);
+                    break;
+                case Source::FIELD:
+                    // payloads are little endian already
+                    column.data.append(reinterpret_cast<const char *>(payload + column.offset), column.width);
+                    break;
+            }
+        }
+        if (++table->rows == table->capacity) {
+            _flush(frame.message_id, *table);
+        }
+    }
+
+    /**
+     * Writes the incomplete batches of all message types.
+     */
+    void flush() {
+        for (auto &[message_id, table] : _tables) {
+            if (table && table->rows > 0) {
+                _flush(message_id, *table);
+            }
+        }
+    }
+};
+
+#endif //MAVTOOLS_COLUMNEXPORT_H
@@ -0,0 +1,235 @@
+/****************************************************************************
+ *
+ * Copyright (c) 2024, libmav development team
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name libmav nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+#ifndef MAVTOOLS_DECODEOPTIONS_H
+#define MAVTOOLS_DECODEOPTIONS_H
+
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+#include "../common/FrameFilter.h"
+#include "../common/MessagePlan.h"
+#include "../common/RecordSerializer.h"
+#include "../common/Tlog.h"
+#include "RateLimiter.h"
+
+/**
+ * Half-open range [from, to) of byte offsets or message indices, written as FROM:TO. Either end may be left out,
+ * and numbers may have a k, M or G suffix for powers of 1024.
+ */
+struct IndexRange {
+    uint64_t from = 0;
+    uint64_t to = std::numeric_limits<uint64_t>::max();
+
+    [[nodiscard]] bool contains(uint64_t index) const {
+        return index >= from && index < to;
+    }
+
+    /**
+     * @throws std::invalid_argument if the range can not be parsed
+     */
+    static IndexRange parse(const std::string &spec) {
+        const size_t colon = spec.find(':');
+        if (colon == std::string::npos) {
+            throw std::invalid_argument("Invalid range, expected FROM:TO: " + spec);
+        }
+        IndexRange range;
+        const std::string from = spec.substr(0, colon);
+        const std::string to = spec.substr(colon + 1);
+        if (!from.empty()) {
+            range.from = parseNumber(from, spec);
+        }
+        if (!to.empty()) {
+            range.to = parseNumber(to, spec);
+        }
+        if (range.to < range.from) {
+            throw std::invalid_argument("Invalid range, end before start: " + spec);
+        }
+        return range;
+    }
+
+private:
+    static uint64_t parseNumber(const std::string &text, const std::string &spec) {
+        size_t parsed = 0;
+        uint64_t value = 0;
+        try {
+            value = std::stoull(text, &parsed);
+        } catch (std::exception &) {
+            parsed = 0;
+        }
+        if (parsed == 0 || text[0] == '-') {
+            throw std::invalid_argument("Invalid range: " + spec);
+        }
+        if (parsed + 1 == text.size()) {
+            int shift = 0;
+            switch (text.back()) {
+                case 'k': shift = 10; break;
+                case 'M': shift = 20; break;
+                case 'G': shift = 30; break;
+                default: break;
+            }
+            if (shift > 0) {
+                if (value > (std::numeric_limits<uint64_t>::max() >> shift)) {
+                    throw std::invalid_argument("Invalid range, number too large: " + spec);
+                }
+                return value << shift;
+            }
+        }
+        if (parsed != text.size()) {
+            throw std::invalid_argument("Invalid range: " + spec);
+        }
+        return value;
+    }
+};
+
+/**
+ * Everything that decides which messages mavdecode outputs, and how. Shared read-only between threads.
+ */
+struct DecodeOptions {
+    const mav::MessageSet &message_set;
+    FrameFilter filter;
+    FieldProjection projection;
+    OutputFormat format = OutputFormat::JSON;
+    // add the receive time to every record
+    bool timestamps = false;
+    // only output the frames with an index in this range, counting every valid frame of the input
+    std::optional<IndexRange> messages;
+    // decimate the accepted messages, only applied to live input
+    RateLimits rate_limits;
+
+    explicit DecodeOptions(const mav::MessageSet &message_set) : message_set(message_set), rate_limits(message_set) {}
+};
+
+/**
+ * @return the file extension for output in the given options, including the dot
+ */
+inline std::string outputExtension(const DecodeOptions &options) {
+    switch (options.format) {
+        case OutputFormat::CSV:
+            return ".csv";
+        case OutputFormat::TSV:
+            return ".tsv";
+        case OutputFormat::CBOR:
+            return ".cbor";
+        case OutputFormat::MSGPACK:
+            return ".msgpack";
+        case OutputFormat::RAW:
+            return options.timestamps ? ".tlog" : ".bin";
+        case OutputFormat::JSON:
+        default:
+            return ".json";
+    }
+}
+
+/**
+ * Per-thread state to turn accepted messages into output records.
+ */
+class RecordFormatter {
+private:
+    const DecodeOptions &_options;
+    MessagePlanCache _plans;
+    // null for raw output
+    std::unique_ptr<RecordSerializer> _serializer;
+    std::string _raw_record;
+
+public:
+    explicit RecordFormatter(const DecodeOptions &options) :
+            _options(options), _plans(options.message_set, &options.projection),
+            _serializer(makeRecordSerializer(options.format, options.timestamps)) {}
+
+    [[nodiscard]] bool accepts(uint32_t message_id, uint8_t system_id, uint8_t component_id) const {
+        return _options.filter.accepts(message_id, system_id, component_id);
+    }
+
+    /**
+     * @return records to be written before any message
+     */
+    std::string preamble() {
+        return _serializer ? _serializer->preamble(_options.projection.plans()) : std::string{};
+    }
+
+    /**
+     * @return the records to be written before the first message of each type, for outputs that only contain
+     * some of the types
+     */
+    std::unordered_map<uint32_t, std::string> preambles() {
+        std::unordered_map<uint32_t, std::string> preambles;
+        if (!_serializer) {
+            return preambles;
+        }
+        for (const auto *plan : _options.projection.plans()) {
+            std::string preamble = _serializer->preamble({plan});
+            if (!preamble.empty()) {
+                preambles.emplace(plan->definition->id(), std::move(preamble));
+            }
+        }
+        return preambles;
+    }
+
+    /**
+     * @return the record for a message, or an empty view if the message has nothing to output
+     */
+    std::string_view format(const RawMessage &message) {
+        const MessagePlan *plan = _plans.get(message.message_id);
+        if (!plan || !_serializer) {
+            return {};
+        }
+        return _serializer->serialize(*plan, message);
+    }
+
+    /**
+     * Like format(), but raw output is the unchanged frame, preceded by its timestamp as a tlog record if
+     * timestamps are enabled.
+     */
+    std::string_view formatFrame(const FrameView &frame, uint64_t timestamp_us = 0) {
+        if (_serializer) {
+            return format(RawMessage::fromFrame(frame, timestamp_us));
+        }
+        std::string_view bytes{reinterpret_cast<const char *>(frame.data), frame.size};
+        if (!_options.timestamps) {
+            return bytes;
+        }
+        auto timestamp = encodeTlogTimestamp(timestamp_us);
+        _raw_record.assign(timestamp.data(), timestamp.size()).append(bytes);
+        return _raw_record;
+    }
+};
+
+#endif //MAVTOOLS_DECODEOPTIONS_H
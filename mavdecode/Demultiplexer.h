@@ -0,0 +1,339 @@
+/****************************************************************************
+ *
+ * Copyright (c) 2024, libmav development team
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name libmav nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+#ifndef MAVTOOLS_DEMULTIPLEXER_H
+#define MAVTOOLS_DEMULTIPLEXER_H
+
+#include <algorithm>
+#include <cerrno>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "../common/Frame.h"
+
+/**
+ * What a capture is split by.
+ */
+class SplitKey {
+public:
+    enum class Kind {
+        SYSTEM,     // system id
+        SOURCE,     // system and component id
+        MESSAGE     // message type
+    };
+
+private:
+    const Kind _kind;
+    const mav::MessageSet &_message_set;
+
+public:
+    SplitKey(Kind kind, const mav::MessageSet &message_set) : _kind(kind), _message_set(message_set) {}
+
+    static std::optional<Kind> parse(const std::string &name) {
+        if (name == "sysid") {
+            return Kind::SYSTEM;
+        } else if (name == "source") {
+            return Kind::SOURCE;
+        } else if (name == "message") {
+            return Kind::MESSAGE;
+        }
+        return std::nullopt;
+    }
+
+    [[nodiscard]] uint32_t key(const FrameView &frame) const {
+        switch (_kind) {
+            case Kind::SYSTEM:
+                return frame.system_id;
+            case Kind::SOURCE:
+                return static_cast<uint32_t>(frame.system_id) << 8 | frame.component_id;
+            case Kind::MESSAGE:
+            default:
+                return frame.message_id;
+        }
+    }
+
+    /**
+     * @return the file name stem for a key
+     */
+    [[nodiscard]] std::string name(uint32_t key) const {
+        switch (_kind) {
+            case Kind::SYSTEM:
+                return "sysid_" + std::to_string(key);
+            case Kind::SOURCE:
+                return "sysid_" + std::to_string(key >> 8) + "_compid_" + std::to_string(key & 0xFF);
+            case Kind::MESSAGE:
+            default: {
+                auto definition = _message_set.getMessageDefinition(static_cast<int>(key));
+                return definition.has_value() ? definition.get().name() : "id_" + std::to_string(key);
+            }
+        }
+    }
+};
+
+/**
+ * Routes records to one output file per key, in a single pass over the input.
+ *
+ * Every output collects its records in its own buffer, which is handed to a pool of writer threads once full.
+ * Each output belongs to one writer thread, so its blocks are written in order without locking, and every
+ * writer keeps at most its share of the open file limit, closing the least recently used file when needed.
+ * Files are truncated when first opened, and appended to when opened again.
+ */
+class Demultiplexer {
+private:
+    // blocks waiting to be written, per writer thread, before the producer waits
+    static constexpr size_t MAX_PENDING_BLOCKS = 8;
+
+    struct Output {
+        std::string path;
+        std::string buffer;
+        size_t writer;
+        // message types whose preamble is already in the file
+        std::unordered_set<uint32_t> introduced;
+        // only used by the writer thread
+        bool created = false;
+        bool failed = false;
+    };
+
+    struct Block {
+        Output *output;
+        std::string data;
+    };
+
+    struct Writer {
+        std::thread thread;
+        std::mutex mutex;
+        std::condition_variable cv;
+        std::deque<Block> pending;
+        bool stopping = false;
+        // open files, most recently used first, only used by the writer thread
+        std::list<std::pair<Output *, int>> open_files;
+        std::unordered_map<Output *, std::list<std::pair<Output *, int>>::iterator> open_index;
+    };
+
+    const std::string _directory;
+    const std::string _extension;
+    const std::unordered_map<uint32_t, std::string> _preambles;
+    const size_t _buffer_size;
+    const size_t _files_per_writer;
+    const SplitKey &_split_key;
+    std::unordered_map<uint32_t, std::unique_ptr<Output>> _outputs;
+    std::vector<std::unique_ptr<Writer>> _writers;
+
+    int _open(Writer &writer, Output &output) {
+        auto it = writer.open_index.find(&output);
+        if (it != writer.open_index.end()) {
+            writer.open_files.splice(writer.open_files.begin(), writer.open_files, it->second);
+            return it->second->second;
+        }
+        if (writer.open_files.size() >= _files_per_writer) {
+            ::close(writer.open_files.back().second);
+            writer.open_index.erase(writer.open_files.back().first);
+            writer.open_files.pop_back();
+        }
+        const int flags = O_WRONLY | O_CREAT | O_CLOEXEC | (output.created ? O_APPEND : O_TRUNC);
+        int fd = ::open(output.path.c_str(), flags, 0644);
+        if (fd < 0) {
+            std::cerr << "Could not open " << output.path << ": " << std::strerror(errno) << std::endl;
+            output.failed = true;
+            return -1;
+        }
+        output.created = true;
+        writer.open_files.emplace_front(&output, fd);
+        writer.open_index[&output] = writer.open_files.begin();
+        return fd;
+    }
+
+    void _write(Writer &writer, Block &block) {
+        if (block.output->failed) {
+            return;
+        }
+        int fd = _open(writer, *block.output);
+        size_t written = 0;
+        while (fd >= 0 && written < block.data.size()) {
+            ssize_t res = ::write(fd, block.data.data() + written, block.data.size() - written);
+            if (res < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                std::cerr << "Error writing " << block.output->path << ": " << std::strerror(errno) << std::endl;
+                block.output->failed = true;
+                return;
+            }
+            written += static_cast<size_t>(res);
+        }
+    }
+
+    void _run(Writer &writer) {
+        std::unique_lock<std::mutex> lock(writer.mutex);
+        while (true) {
+            writer.cv.wait(lock, [&writer] { return writer.stopping || !writer.pending.empty(); });
+            if (writer.pending.empty()) {
+                break;
+            }
+            Block block = std::move(writer.pending.front());
+            writer.pending.pop_front();
+            writer.cv.notify_all();
+            lock.unlock();
+            _write(writer, block);
+            lock.lock();
+        }
+        for (auto &[output, fd] : writer.open_files) {
+            ::close(fd);
+        }
+        writer.open_files.clear();
+        writer.open_index.clear();
+    }
+
+    void _handOff(Output &output) {
+        Writer &writer = *_writers[output.writer];
+        std::unique_lock<std::mutex> lock(writer.mutex);
+        writer.cv.wait(lock, [&writer] { return writer.pending.size() < MAX_PENDING_BLOCKS; });
+        writer.pending.push_back({&output, std::move(output.buffer)});
+        writer.cv.notify_all();
+        lock.unlock();
+        output.buffer.clear();
+        output.buffer.reserve(_buffer_size);
+    }
+
+    Output &_output(uint32_t key) {
+        auto it = _outputs.find(key);
+        if (it == _outputs.end()) {
+            auto output = std::make_unique<Output>();
+            output->path = _directory + "/" + _split_key.name(key) + _extension;
+            output->writer = _outputs.size() % _writers.size();
+            output->buffer.reserve(_buffer_size);
+            it = _outputs.emplace(key, std::move(output)).first;
+        }
+        return *it->second;
+    }
+
+    void _append(Output &output, std::string_view record) {
+        output.buffer.append(record);
+        if (output.buffer.size() >= _buffer_size) {
+            _handOff(output);
+        }
+    }
+
+public:
+    /**
+     * @param extension appended to the key name, including the dot
+     * @param preambles per message id, written before the first record of that type in every file, e.g. CSV
+     * header rows
+     */
+    Demultiplexer(const SplitKey &split_key, std::string directory, std::string extension,
+                  std::unordered_map<uint32_t, std::string> preambles, int writers, size_t max_open_files,
+                  size_t buffer_size = 256 * 1024) :
+            _directory(std::move(directory)), _extension(std::move(extension)), _preambles(std::move(preambles)),
+            _buffer_size(buffer_size),
+            _files_per_writer(std::max<size_t>(max_open_files / std::max(writers, 1), 1)),
+            _split_key(split_key) {
+        for (int i = 0; i < std::max(writers, 1); i++) {
+            _writers.push_back(std::make_unique<Writer>());
+            Writer &writer = *_writers.back();
+            writer.thread = std::thread([this, &writer] { _run(writer); });
+        }
+    }
+
+    Demultiplexer(const Demultiplexer &) = delete;
+    Demultiplexer &operator=(const Demultiplexer &) = delete;
+
+    ~Demultiplexer() {
+        close();
+    }
+
+    /**
+     * Appends a record to the output of the frame's key, after the preamble of its message type if it is the
+     * first of that type in the output.
+     */
+    void write(const FrameView &frame, std::string_view record) {
+        Output &output = _output(_split_key.key(frame));
+        if (!_preambles.empty() && output.introduced.insert(frame.message_id).second) {
+            auto preamble = _preambles.find(frame.message_id);
+            if (preamble != _preambles.end()) {
+                output.buffer.append(preamble->second);
+            }
+        }
+        _append(output, record);
+    }
+
+    /**
+     * Appends a record to the output of a key, without any preamble.
+     */
+    void write(uint32_t key, std::string_view record) {
+        _append(_output(key), record);
+    }
+
+    /**
+     * Writes out all buffered records, and stops the writer threads.
+     */
+    void close() {
+        if (_writers.empty() || !_writers.front()->thread.joinable()) {
+            return;
+        }
+        for (auto &[key, output] : _outputs) {
+            if (!output->buffer.empty()) {
+                _handOff(*output);
+            }
+        }
+        for (auto &writer : _writers) {
+            {
+                std::lock_guard<std::mutex> lock(writer->mutex);
+                writer->stopping = true;
+                writer->cv.notify_all();
+            }
+            writer->thread.join();
+        }
+    }
+
+    [[nodiscard]] size_t outputs() const {
+        return _outputs.size();
+    }
+};
+
+#endif //MAVTOOLS_DEMULTIPLEXER_H
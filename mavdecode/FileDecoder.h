@@ -0,0 +1,298 @@
+/****************************************************************************
+ *
+ * Copyright (c) 2024, libmav development team
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name libmav nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+#ifndef MAVTOOLS_FILEDECODER_H
+#define MAVTOOLS_FILEDECODER_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../common/Frame.h"
+#include "../common/OutputWriter.h"
+#include "CaptureIndex.h"
+#include "DecodeOptions.h"
+
+/**
+ * Decodes the frames of an in-memory capture that start within a given byte range.
+ * Frames are located with the FrameScanner, so a range can start at an arbitrary offset.
+ * A message index range in the options counts frames across calls, so it needs a single decoder going
+ * through the capture from its start.
+ */
+class RangeDecoder {
+private:
+    FrameScanner _scanner;
+    RecordFormatter _formatter;
+    const std::optional<IndexRange> _messages;
+    // index of the next frame, only meaningful when decoding a capture from its start in one go
+    uint64_t _frame_index = 0;
+
+public:
+    explicit RangeDecoder(const DecodeOptions &options) :
+            _scanner(options.message_set), _formatter(options), _messages(options.messages) {}
+
+    /**
+     * Calls sink(frame_start, frame_end, record) for every frame starting in [from, end) of data[0, limit).
+     * The record is empty for frames without output. Frames rejected by the filter are never serialized.
+     * @return the end offset of the last frame, or from if there was none
+     */
+    template<typename Sink>
+    size_t decode(const uint8_t *data, size_t from, size_t end, size_t limit,
+                  const std::atomic_bool &interrupted, Sink &&sink) {
+        size_t frame_end = from;
+        size_t offset = from;
+        FrameView frame;
+        while (!interrupted.load(std::memory_order_relaxed)) {
+            offset = _scanner.find(data, offset, end, limit, frame);
+            if (offset >= end) {
+                break;
+            }
+            const uint64_t index = _frame_index++;
+            if (_messages && index >= _messages->to) {
+                break;
+            }
+            frame_end = offset + frame.size;
+            if ((!_messages || _messages->contains(index)) &&
+                    _formatter.accepts(frame.message_id, frame.system_id, frame.component_id)) {
+                sink(offset, frame_end, _formatter.formatFrame(frame));
+            } else {
+                sink(offset, frame_end, std::string_view{});
+            }
+            offset = frame_end;
+        }
+        return frame_end;
+    }
+};
+
+/**
+ * Decodes the regions of an in-memory capture selected with its CaptureIndex. With a time range, frames are
+ * only decoded while the boot time, as of the last frame with a time field, lies within it.
+ */
+class IndexedDecoder {
+private:
+    FrameScanner _scanner;
+    FrameClock _clock;
+    RecordFormatter _formatter;
+    const std::optional<int64_t> _from_ms;
+    const std::optional<int64_t> _to_ms;
+
+    [[nodiscard]] bool _inTime(int64_t time_ms) const {
+        if (!_from_ms && !_to_ms) {
+            return true;
+        }
+        return time_ms != FrameClock::NO_TIME && (!_from_ms || time_ms >= *_from_ms) && (!_to_ms || time_ms <= *_to_ms);
+    }
+
+public:
+    IndexedDecoder(const DecodeOptions &options, std::optional<int64_t> from_ms, std::optional<int64_t> to_ms) :
+            _scanner(options.message_set), _clock(options.message_set), _formatter(options),
+            _from_ms(from_ms), _to_ms(to_ms) {}
+
+    /**
+     * Calls sink(record) for every frame with output.
+     */
+    template<typename Sink>
+    void decode(const uint8_t *data, size_t size, const std::vector<CaptureIndex::Region> &regions,
+                const std::atomic_bool &interrupted, Sink &&sink) {
+        FrameView frame;
+        for (const auto &region : regions) {
+            int64_t time_ms = region.start_time;
+            const size_t end = std::min<uint64_t>(region.end, size);
+            size_t offset = region.begin;
+            while (!interrupted.load(std::memory_order_relaxed) &&
+                    (offset = _scanner.find(data, offset, end, size, frame)) < end) {
+                offset += frame.size;
+                const int64_t frame_time = _clock.timeMs(frame);
+                if (frame_time != FrameClock::NO_TIME) {
+                    time_ms = frame_time;
+                }
+                if (_inTime(time_ms) && _formatter.accepts(frame.message_id, frame.system_id, frame.component_id)) {
+                    auto record = _formatter.formatFrame(frame);
+                    if (!record.empty()) {
+                        sink(record);
+                    }
+                }
+            }
+        }
+    }
+};
+
+/**
+ * Decodes an in-memory capture on a pool of worker threads, and writes the records in their original order.
+ *
+ * The capture is cut into chunks of at most MAX_CHUNK_SIZE, so the memory in flight only depends on the number
+ * of threads. Every worker decodes the frames starting within its chunk, reading past the chunk end for the last
+ * frame. The first frame of a chunk is found by magic byte and checksum. When stitching chunks together, records
+ * of frames that started inside the previous chunk's last frame are dropped, and a chunk that synchronized onto
+ * a false frame is decoded again sequentially.
+ */
+class ParallelFileDecoder {
+private:
+    static constexpr size_t MIN_CHUNK_SIZE = 1024 * 1024; // 1 MiB
+    // bounds the decoded output held for stitching, whatever the size of the capture
+    static constexpr size_t MAX_CHUNK_SIZE = 8 * 1024 * 1024; // 8 MiB
+    static constexpr size_t CHUNKS_PER_THREAD = 8;
+    // maximum number of decoded chunks waiting to be written, per thread
+    static constexpr size_t WINDOW_PER_THREAD = 2;
+
+    // every frame of the chunk, including the ones without output, to be able to stitch chunks
+    struct Record {
+        size_t frame_start;
+        size_t frame_end;
+        size_t text_end;
+    };
+
+    struct DecodedChunk {
+        std::string text;
+        std::vector<Record> records;
+    };
+
+    const DecodeOptions &_options;
+    const int _threads;
+    // 0 to derive it from the capture size
+    const size_t _chunk_size;
+
+    static DecodedChunk decodeChunk(RangeDecoder &decoder, const uint8_t *data, size_t from, size_t end, size_t limit,
+                                    const std::atomic_bool &interrupted) {
+        DecodedChunk chunk;
+        decoder.decode(data, from, end, limit, interrupted,
+                       [&chunk](size_t frame_start, size_t frame_end, std::string_view record) {
+            chunk.text.append(record);
+            chunk.records.push_back({frame_start, frame_end, chunk.text.size()});
+        });
+        return chunk;
+    }
+
+public:
+    ParallelFileDecoder(const DecodeOptions &options, int threads, size_t chunk_size = 0) :
+            _options(options), _threads(std::max(threads, 1)), _chunk_size(chunk_size) {}
+
+    void decode(const uint8_t *data, size_t size, OutputWriter &output, const std::atomic_bool &interrupted) {
+        const size_t chunk_size = _chunk_size > 0 ? _chunk_size :
+                std::clamp(size / (_threads * CHUNKS_PER_THREAD) + 1, MIN_CHUNK_SIZE, MAX_CHUNK_SIZE);
+        const size_t chunk_count = (size + chunk_size - 1) / chunk_size;
+        const size_t window = _threads * WINDOW_PER_THREAD;
+
+        std::vector<std::optional<DecodedChunk>> chunks(chunk_count);
+        size_t next_chunk = 0;
+        size_t written_chunks = 0;
+        std::mutex mutex;
+        std::condition_variable cv;
+
+        auto worker = [&] {
+            RangeDecoder decoder{_options};
+            std::unique_lock<std::mutex> lock(mutex);
+            while (true) {
+                cv.wait(lock, [&] {
+                    return next_chunk >= chunk_count || next_chunk < written_chunks + window || interrupted.load();
+                });
+                if (next_chunk >= chunk_count || interrupted.load()) {
+                    return;
+                }
+                const size_t index = next_chunk++;
+                lock.unlock();
+                const size_t from = index * chunk_size;
+                auto chunk = decodeChunk(decoder, data, from, std::min(from + chunk_size, size), size, interrupted);
+                lock.lock();
+                chunks[index] = std::move(chunk);
+                cv.notify_all();
+            }
+        };
+
+        std::vector<std::thread> workers;
+        for (int i = 0; i < _threads; i++) {
+            workers.emplace_back(worker);
+        }
+
+        RangeDecoder stitch_decoder{_options};
+        // end of the last frame written so far
+        size_t position = 0;
+        for (size_t index = 0; index < chunk_count && !interrupted.load(); index++) {
+            DecodedChunk chunk;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                // wake up periodically to check for interrupts
+                while (!chunks[index].has_value() && !interrupted.load()) {
+                    cv.wait_for(lock, std::chrono::milliseconds(100));
+                }
+                if (!chunks[index].has_value()) {
+                    break;
+                }
+                chunk = std::move(*chunks[index]);
+                chunks[index].reset();
+            }
+
+            size_t first_kept = 0;
+            while (first_kept < chunk.records.size() && chunk.records[first_kept].frame_start < position) {
+                first_kept++;
+            }
+            if (first_kept > 0 && chunk.records[first_kept - 1].frame_end > position) {
+                // the chunk synchronized onto a frame overlapping the previous chunk's last frame
+                const size_t chunk_end = std::min((index + 1) * chunk_size, size);
+                chunk = decodeChunk(stitch_decoder, data, position, chunk_end, size, interrupted);
+                first_kept = 0;
+            }
+
+            if (first_kept < chunk.records.size()) {
+                const size_t text_start = first_kept > 0 ? chunk.records[first_kept - 1].text_end : 0;
+                if (text_start < chunk.text.size()) {
+                    output.write(std::string_view{chunk.text}.substr(text_start));
+                }
+                position = chunk.records.back().frame_end;
+            }
+
+            std::lock_guard<std::mutex> lock(mutex);
+            written_chunks = index + 1;
+            cv.notify_all();
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            // release workers waiting for the window, if we stopped early
+            next_chunk = chunk_count;
+            cv.notify_all();
+        }
+        for (auto &thread : workers) {
+            thread.join();
+        }
+    }
+};
+
+#endif //MAVTOOLS_FILEDECODER_H
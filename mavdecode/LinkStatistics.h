@@ -0,0 +1,211 @@
+/****************************************************************************
+ *
+ * Copyright (c) 2024, libmav development team
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name libmav nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+#ifndef MAVTOOLS_LINKSTATISTICS_H
+#define MAVTOOLS_LINKSTATISTICS_H
+
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "../common/Frame.h"
+#include "../common/JsonWriter.h"
+
+/**
+ * Message rate, bandwidth, checksum and sequence counters per (system id, component id, message id),
+ * computed from frame headers only. Rates are reported over a sliding window.
+ */
+class LinkStatistics {
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Counters {
+        uint64_t messages = 0;
+        uint64_t bytes = 0;
+        uint64_t crc_errors = 0;
+    };
+
+    struct SourceCounters {
+        uint64_t messages = 0;
+        uint64_t lost = 0;      // messages missing according to the sequence numbers
+        uint64_t gaps = 0;      // number of discontinuities in the sequence numbers
+    };
+
+    struct Stream {
+        uint32_t source;
+        uint32_t message_id;
+    };
+
+    struct Source {
+        uint8_t system_id;
+        uint8_t component_id;
+        int last_seq = -1;
+        // index into _streams, flat by message id
+        std::vector<int32_t> streams;
+    };
+
+    struct Snapshot {
+        Clock::time_point time;
+        std::vector<Counters> streams;
+        std::vector<SourceCounters> sources;
+    };
+
+    const mav::MessageSet &_message_set;
+    const Clock::time_point _start = Clock::now();
+    std::vector<int32_t> _source_index = std::vector<int32_t>(256 * 256, -1);
+    std::vector<Source> _sources;
+    std::vector<Stream> _streams;
+    Snapshot _current;
+    std::deque<Snapshot> _history;
+    JsonWriter _writer;
+
+    uint32_t _source(uint8_t system_id, uint8_t component_id) {
+        int32_t &index = _source_index[(system_id << 8) | component_id];
+        if (index < 0) {
+            index = static_cast<int32_t>(_sources.size());
+            _sources.push_back({system_id, component_id, -1, {}});
+            _current.sources.emplace_back();
+        }
+        return static_cast<uint32_t>(index);
+    }
+
+    Counters &_stream(uint32_t source, uint32_t message_id) {
+        auto &streams = _sources[source].streams;
+        if (message_id >= streams.size()) {
+            streams.resize(message_id + 1, -1);
+        }
+        int32_t &index = streams[message_id];
+        if (index < 0) {
+            index = static_cast<int32_t>(_streams.size());
+            _streams.push_back({source, message_id});
+            _current.streams.emplace_back();
+        }
+        return _current.streams[index];
+    }
+
+public:
+    explicit LinkStatistics(const mav::MessageSet &message_set) : _message_set(message_set) {
+        _history.push_back({_start, {}, {}});
+    }
+
+    /**
+     * Every valid frame has to be passed in, also the filtered out ones with accepted set to false. Those only
+     * count for the sequence numbers of their source, so filtering does not show up as lost messages.
+     */
+    void onFrame(const FrameView &frame, bool accepted = true) {
+        const uint32_t source = _source(frame.system_id, frame.component_id);
+        if (accepted) {
+            auto &counters = _stream(source, frame.message_id);
+            counters.messages++;
+            counters.bytes += frame.size;
+        }
+
+        auto &source_counters = _current.sources[source];
+        source_counters.messages++;
+        int &last_seq = _sources[source].last_seq;
+        if (last_seq >= 0) {
+            const int lost = (frame.seq - last_seq - 1) & 0xFF;
+            if (lost > 0) {
+                source_counters.lost += lost;
+                source_counters.gaps++;
+            }
+        }
+        last_seq = frame.seq;
+    }
+
+    void onCrcError(const FrameView &frame) {
+        _stream(_source(frame.system_id, frame.component_id), frame.message_id).crc_errors++;
+    }
+
+    /**
+     * @return one JSON line with the totals and the rates over the last window seconds
+     */
+    std::string_view report(std::chrono::duration<double> window, uint64_t discarded_bytes) {
+        const auto now = Clock::now();
+        _history.push_back({now, _current.streams, _current.sources});
+        while (_history.size() > 1 && now - _history[1].time >= window) {
+            _history.pop_front();
+        }
+        const Snapshot &base = _history.front();
+        const double seconds = std::chrono::duration<double>(now - base.time).count();
+        auto rate = [seconds](uint64_t current, uint64_t previous) {
+            return seconds > 0 ? static_cast<double>(current - previous) / seconds : 0.0;
+        };
+
+        _writer.clear();
+        _writer.raw("{\"elapsed\": ").number(std::chrono::duration<double>(now - _start).count());
+        _writer.raw(", \"window\": ").number(seconds);
+        _writer.raw(", \"discarded_bytes\": ").number(discarded_bytes);
+        _writer.raw(", \"streams\": [");
+        for (size_t i = 0; i < _streams.size(); i++) {
+            const auto &stream = _streams[i];
+            const auto &source = _sources[stream.source];
+            const auto &current = _current.streams[i];
+            const Counters previous = i < base.streams.size() ? base.streams[i] : Counters{};
+            auto definition = _message_set.getMessageDefinition(static_cast<int>(stream.message_id));
+            _writer.raw(i > 0 ? ", {" : "{");
+            _writer.raw("\"system_id\": ").number(source.system_id);
+            _writer.raw(", \"component_id\": ").number(source.component_id);
+            _writer.raw(", \"id\": ").number(stream.message_id);
+            _writer.raw(", \"name\": ").string(definition.has_value() ? definition.get().name() : "");
+            _writer.raw(", \"messages\": ").number(current.messages);
+            _writer.raw(", \"messages_per_second\": ").number(rate(current.messages, previous.messages));
+            _writer.raw(", \"bytes_per_second\": ").number(rate(current.bytes, previous.bytes));
+            _writer.raw(", \"crc_errors\": ").number(current.crc_errors);
+            _writer.raw(", \"crc_errors_per_second\": ").number(rate(current.crc_errors, previous.crc_errors));
+            _writer.raw('}');
+        }
+        _writer.raw("], \"sources\": [");
+        for (size_t i = 0; i < _sources.size(); i++) {
+            const auto &source = _sources[i];
+            const auto &current = _current.sources[i];
+            const SourceCounters previous = i < base.sources.size() ? base.sources[i] : SourceCounters{};
+            _writer.raw(i > 0 ? ", {" : "{");
+            _writer.raw("\"system_id\": ").number(source.system_id);
+            _writer.raw(", \"component_id\": ").number(source.component_id);
+            _writer.raw(", \"messages\": ").number(current.messages);
+            _writer.raw(", \"messages_per_second\": ").number(rate(current.messages, previous.messages));
+            _writer.raw(", \"lost\": ").number(current.lost);
+            _writer.raw(", \"lost_per_second\": ").number(rate(current.lost, previous.lost));
+            _writer.raw(", \"sequence_gaps\": ").number(current.gaps);
+            _writer.raw('}');
+        }
+        _writer.raw("]}\n");
+        return _writer.view();
+    }
+};
+
+#endif //MAVTOOLS_LINKSTATISTICS_H
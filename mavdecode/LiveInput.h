@@ -0,0 +1,490 @@
+/****************************************************************************
+ *
+ * Copyright (c) 2024, libmav development team
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name libmav nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+#ifndef MAVTOOLS_LIVEINPUT_H
+#define MAVTOOLS_LIVEINPUT_H
+
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "../common/Frame.h"
+#include "../common/StreamScanner.h"
+#include "../common/Tlog.h"
+
+/**
+ * What an input received so far. Reads that fill the whole buffer mean that more data was already waiting,
+ * so a growing share of them shows that the decoder falls behind its input.
+ */
+struct InputCounters {
+    uint64_t bytes = 0;
+    uint64_t reads = 0;
+    uint64_t full_reads = 0;
+
+    void add(size_t size, size_t capacity) {
+        bytes += size;
+        reads++;
+        full_reads += size == capacity;
+    }
+};
+
+/**
+ * Live input from a file descriptor, such as stdin or a pipe, framed incrementally.
+ */
+class DescriptorInput {
+private:
+    const int _fd;
+    FrameScanner _frame_scanner;
+    StreamScanner _stream_scanner;
+    uint64_t _receive_time_us = 0;
+    InputCounters _counters;
+
+public:
+    DescriptorInput(const mav::MessageSet &message_set, int fd) :
+            _fd(fd), _frame_scanner(message_set), _stream_scanner(_frame_scanner) {}
+
+    /**
+     * Waits up to timeout for data, and calls on_frame / on_crc_error for the frames it completes.
+     * @return false at the end of the input
+     */
+    template<typename OnFrame, typename OnCrcError>
+    bool poll(std::chrono::milliseconds timeout, OnFrame &&on_frame, OnCrcError &&on_crc_error) {
+        pollfd poll_fd{_fd, POLLIN, 0};
+        if (::poll(&poll_fd, 1, static_cast<int>(std::max<int64_t>(timeout.count(), 0))) <= 0) {
+            return true;
+        }
+        // writePointer() makes room first, so it has to come before writableSize()
+        uint8_t *destination = _stream_scanner.writePointer();
+        const size_t capacity = _stream_scanner.writableSize();
+        ssize_t size = ::read(_fd, destination, capacity);
+        if (size > 0) {
+            _receive_time_us = wallClockMicros();
+            _counters.add(size, capacity);
+            _stream_scanner.commit(size);
+            _stream_scanner.scan(on_frame, on_crc_error);
+            return true;
+        }
+        if (size < 0 && errno == EINTR) {
+            return true;
+        }
+        _stream_scanner.finish(on_frame, on_crc_error);
+        return false;
+    }
+
+    /**
+     * @return when the frame passed to on_frame was received, in microseconds since the Unix epoch
+     */
+    [[nodiscard]] uint64_t receiveTime() const {
+        return _receive_time_us;
+    }
+
+    [[nodiscard]] uint64_t discardedBytes() const {
+        return _stream_scanner.discardedBytes();
+    }
+
+    [[nodiscard]] const InputCounters &counters() const {
+        return _counters;
+    }
+};
+
+/**
+ * Input from a tlog capture, where every frame comes with its recorded receive time.
+ */
+class TlogInput {
+private:
+    static constexpr size_t BLOCK_SIZE = 64 * 1024;
+
+    const int _fd;
+    FrameScanner _frame_scanner;
+    std::vector<uint8_t> _buffer;
+    size_t _end = 0;
+    uint64_t _receive_time_us = 0;
+    uint64_t _discarded_bytes = 0;
+    InputCounters _counters;
+
+public:
+    TlogInput(const mav::MessageSet &message_set, int fd) :
+            _fd(fd), _frame_scanner(message_set),
+            _buffer(BLOCK_SIZE + TLOG_TIMESTAMP_SIZE + MAVLINK_HEADER_SIZE_V2 + 255 + MAVLINK_CHECKSUM_SIZE +
+                    MAVLINK_SIGNATURE_SIZE) {}
+
+    /**
+     * Same as DescriptorInput::poll(). Records with a bad checksum are skipped.
+     */
+    template<typename OnFrame, typename OnCrcError>
+    bool poll(std::chrono::milliseconds timeout, OnFrame &&on_frame, OnCrcError &&) {
+        pollfd poll_fd{_fd, POLLIN, 0};
+        if (::poll(&poll_fd, 1, static_cast<int>(std::max<int64_t>(timeout.count(), 0))) <= 0) {
+            return true;
+        }
+        const size_t capacity = _buffer.size() - _end;
+        ssize_t size = ::read(_fd, _buffer.data() + _end, capacity);
+        if (size <= 0) {
+            if (size < 0 && errno == EINTR) {
+                return true;
+            }
+            scanTlogEnd(_frame_scanner, _buffer.data(), _end, _discarded_bytes,
+                        [this, &on_frame](uint64_t timestamp_us, const FrameView &frame) {
+                _receive_time_us = timestamp_us;
+                on_frame(frame);
+            });
+            _end = 0;
+            return false;
+        }
+        _counters.add(size, capacity);
+        _end += static_cast<size_t>(size);
+        size_t consumed = scanTlogBlock(_frame_scanner, _buffer.data(), _end, _discarded_bytes,
+                                        [this, &on_frame](uint64_t timestamp_us, const FrameView &frame) {
+            _receive_time_us = timestamp_us;
+            on_frame(frame);
+        });
+        std::memmove(_buffer.data(), _buffer.data() + consumed, _end - consumed);
+        _end -= consumed;
+        return true;
+    }
+
+    /**
+     * @return the recorded receive time of the frame passed to on_frame
+     */
+    [[nodiscard]] uint64_t receiveTime() const {
+        return _receive_time_us;
+    }
+
+    [[nodiscard]] uint64_t discardedBytes() const {
+        return _discarded_bytes;
+    }
+
+    [[nodiscard]] const InputCounters &counters() const {
+        return _counters;
+    }
+};
+
+/**
+ * Live input from sockets: UDP sockets bound to local endpoints and TCP connections to servers, all served
+ * by one epoll loop. UDP datagrams are received in batches with recvmmsg, and every datagram is framed
+ * on its own, so a truncated or corrupt datagram never affects the next one. Datagrams carry the receive
+ * time of the kernel, which is not delayed by batching.
+ */
+class NetworkInput {
+private:
+    static constexpr size_t DATAGRAM_BATCH = 64;
+    static constexpr size_t MAX_DATAGRAM_SIZE = 64 * 1024;
+    static constexpr int MAX_EVENTS = 16;
+
+    struct Connection {
+        int fd;
+        std::string name;
+        // only for TCP connections
+        std::unique_ptr<StreamScanner> stream_scanner;
+    };
+
+    const mav::MessageSet &_message_set;
+    FrameScanner _frame_scanner;
+    int _epoll_fd;
+    std::vector<std::unique_ptr<Connection>> _connections;
+    size_t _open_connections = 0;
+    uint64_t _discarded_bytes = 0;
+    uint64_t _truncated_datagrams = 0;
+    uint64_t _receive_time_us = 0;
+    InputCounters _counters;
+
+    std::vector<uint8_t> _datagrams;
+    std::vector<iovec> _iovecs;
+    std::vector<mmsghdr> _headers;
+    std::vector<uint8_t> _control;
+
+    static constexpr size_t CONTROL_SIZE = CMSG_SPACE(sizeof(timeval));
+
+    static uint64_t _kernelTimestamp(const msghdr &header) {
+        for (cmsghdr *message = CMSG_FIRSTHDR(&header); message; message = CMSG_NXTHDR(const_cast<msghdr *>(&header), message)) {
+            if (message->cmsg_level == SOL_SOCKET && message->cmsg_type == SCM_TIMESTAMP) {
+                timeval time{};
+                std::memcpy(&time, CMSG_DATA(message), sizeof(time));
+                return static_cast<uint64_t>(time.tv_sec) * 1000000 + static_cast<uint64_t>(time.tv_usec);
+            }
+        }
+        return wallClockMicros();
+    }
+
+    /**
+     * Splits host:port, where host may be empty for all interfaces, or an IPv6 address in brackets.
+     */
+    static std::pair<std::string, std::string> _splitEndpoint(const std::string &endpoint) {
+        const size_t colon = endpoint.rfind(':');
+        if (colon == std::string::npos || colon + 1 == endpoint.size()) {
+            throw std::invalid_argument("Expected host:port, got: " + endpoint);
+        }
+        std::string host = endpoint.substr(0, colon);
+        if (host.size() >= 2 && host.front() == '[' && host.back() == ']') {
+            host = host.substr(1, host.size() - 2);
+        }
+        return {host, endpoint.substr(colon + 1)};
+    }
+
+    static addrinfo *_resolve(const std::string &endpoint, int socket_type, bool passive) {
+        auto [host, port] = _splitEndpoint(endpoint);
+        addrinfo hints{};
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = socket_type;
+        hints.ai_flags = passive ? AI_PASSIVE : 0;
+        addrinfo *result = nullptr;
+        int error = ::getaddrinfo(host.empty() ? nullptr : host.c_str(), port.c_str(), &hints, &result);
+        if (error != 0) {
+            throw std::runtime_error("Could not resolve " + endpoint + ": " + ::gai_strerror(error));
+        }
+        return result;
+    }
+
+    void _add(int fd, std::string name, bool is_tcp) {
+        auto connection = std::make_unique<Connection>(Connection{fd, std::move(name), nullptr});
+        if (is_tcp) {
+            connection->stream_scanner = std::make_unique<StreamScanner>(_frame_scanner);
+        }
+        epoll_event event{};
+        event.events = EPOLLIN;
+        event.data.ptr = connection.get();
+        if (::epoll_ctl(_epoll_fd, EPOLL_CTL_ADD, fd, &event) != 0) {
+            ::close(fd);
+            throw std::runtime_error("Could not watch " + connection->name + ": " + std::strerror(errno));
+        }
+        _connections.push_back(std::move(connection));
+        _open_connections++;
+    }
+
+    void _close(Connection &connection) {
+        ::epoll_ctl(_epoll_fd, EPOLL_CTL_DEL, connection.fd, nullptr);
+        ::close(connection.fd);
+        connection.fd = -1;
+        _open_connections--;
+    }
+
+    template<typename OnFrame, typename OnCrcError>
+    void _receiveDatagrams(Connection &connection, OnFrame &on_frame, OnCrcError &on_crc_error) {
+        for (size_t i = 0; i < DATAGRAM_BATCH; i++) {
+            _headers[i].msg_hdr.msg_flags = 0;
+            _headers[i].msg_hdr.msg_controllen = CONTROL_SIZE;
+        }
+        int count = ::recvmmsg(connection.fd, _headers.data(), DATAGRAM_BATCH, MSG_DONTWAIT, nullptr);
+        if (count < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                std::cerr << "Error receiving from " << connection.name << ": " << std::strerror(errno) << std::endl;
+            }
+            return;
+        }
+        // a full batch means more datagrams are queued
+        _counters.reads++;
+        _counters.full_reads += static_cast<size_t>(count) == DATAGRAM_BATCH;
+        for (int i = 0; i < count; i++) {
+            const size_t size = _headers[i].msg_len;
+            _counters.bytes += size;
+            if (_headers[i].msg_hdr.msg_flags & MSG_TRUNC) {
+                _truncated_datagrams++;
+            }
+            _receive_time_us = _kernelTimestamp(_headers[i].msg_hdr);
+            const uint8_t *datagram = _datagrams.data() + i * MAX_DATAGRAM_SIZE;
+            StreamScanner::scanDatagram(_frame_scanner, datagram, size, _discarded_bytes, on_frame, on_crc_error);
+        }
+    }
+
+    template<typename OnFrame, typename OnCrcError>
+    void _receiveStream(Connection &connection, OnFrame &on_frame, OnCrcError &on_crc_error) {
+        StreamScanner &scanner = *connection.stream_scanner;
+        uint8_t *destination = scanner.writePointer();
+        const size_t capacity = scanner.writableSize();
+        ssize_t size = ::read(connection.fd, destination, capacity);
+        if (size > 0) {
+            _receive_time_us = wallClockMicros();
+            _counters.add(size, capacity);
+            scanner.commit(size);
+            scanner.scan(on_frame, on_crc_error);
+        } else if (size == 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+            std::cerr << "Connection to " << connection.name << " closed" << std::endl;
+            // nothing will complete a frame at the end any more
+            scanner.finish(on_frame, on_crc_error);
+            _close(connection);
+        }
+    }
+
+public:
+    explicit NetworkInput(const mav::MessageSet &message_set) :
+            _message_set(message_set), _frame_scanner(message_set), _epoll_fd(::epoll_create1(EPOLL_CLOEXEC)) {
+        if (_epoll_fd < 0) {
+            throw std::runtime_error(std::string{"Could not create epoll instance: "} + std::strerror(errno));
+        }
+    }
+
+    NetworkInput(const NetworkInput &) = delete;
+    NetworkInput &operator=(const NetworkInput &) = delete;
+
+    ~NetworkInput() {
+        for (auto &connection : _connections) {
+            if (connection->fd >= 0) {
+                ::close(connection->fd);
+            }
+        }
+        ::close(_epoll_fd);
+    }
+
+    /**
+     * Receives UDP datagrams sent to a local host:port. An empty host listens on all interfaces.
+     */
+    void addUdp(const std::string &endpoint) {
+        addrinfo *addresses = _resolve(endpoint, SOCK_DGRAM, true);
+        int fd = ::socket(addresses->ai_family, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        int enable = 1;
+        if (fd < 0 || ::setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable)) != 0 ||
+                ::setsockopt(fd, SOL_SOCKET, SO_TIMESTAMP, &enable, sizeof(enable)) != 0 ||
+                ::bind(fd, addresses->ai_addr, addresses->ai_addrlen) != 0) {
+            std::string error = std::strerror(errno);
+            ::freeaddrinfo(addresses);
+            if (fd >= 0) {
+                ::close(fd);
+            }
+            throw std::runtime_error("Could not listen on udp " + endpoint + ": " + error);
+        }
+        ::freeaddrinfo(addresses);
+
+        if (_datagrams.empty()) {
+            _datagrams.resize(DATAGRAM_BATCH * MAX_DATAGRAM_SIZE);
+            _iovecs.resize(DATAGRAM_BATCH);
+            _headers.resize(DATAGRAM_BATCH);
+            _control.resize(DATAGRAM_BATCH * CONTROL_SIZE);
+            for (size_t i = 0; i < DATAGRAM_BATCH; i++) {
+                _iovecs[i] = {_datagrams.data() + i * MAX_DATAGRAM_SIZE, MAX_DATAGRAM_SIZE};
+                _headers[i] = {};
+                _headers[i].msg_hdr.msg_iov = &_iovecs[i];
+                _headers[i].msg_hdr.msg_iovlen = 1;
+                _headers[i].msg_hdr.msg_control = _control.data() + i * CONTROL_SIZE;
+            }
+        }
+        _add(fd, "udp " + endpoint, false);
+    }
+
+    /**
+     * Connects to a TCP server at host:port.
+     */
+    void addTcp(const std::string &endpoint) {
+        addrinfo *addresses = _resolve(endpoint, SOCK_STREAM, false);
+        int fd = -1;
+        std::string error = "no address";
+        for (addrinfo *address = addresses; address && fd < 0; address = address->ai_next) {
+            fd = ::socket(address->ai_family, SOCK_STREAM | SOCK_CLOEXEC, 0);
+            if (fd >= 0 && ::connect(fd, address->ai_addr, address->ai_addrlen) != 0) {
+                error = std::strerror(errno);
+                ::close(fd);
+                fd = -1;
+            }
+        }
+        ::freeaddrinfo(addresses);
+        if (fd < 0) {
+            throw std::runtime_error("Could not connect to tcp " + endpoint + ": " + error);
+        }
+        ::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) | O_NONBLOCK);
+        _add(fd, "tcp " + endpoint, true);
+    }
+
+    /**
+     * Waits up to timeout for data on any socket, and calls on_frame / on_crc_error for the frames received.
+     * @return false once all sockets are closed
+     */
+    template<typename OnFrame, typename OnCrcError>
+    bool poll(std::chrono::milliseconds timeout, OnFrame &&on_frame, OnCrcError &&on_crc_error) {
+        if (_open_connections == 0) {
+            return false;
+        }
+        epoll_event events[MAX_EVENTS];
+        int count = ::epoll_wait(_epoll_fd, events, MAX_EVENTS, static_cast<int>(std::max<int64_t>(timeout.count(), 0)));
+        if (count < 0 && errno != EINTR) {
+            throw std::runtime_error(std::string{"Error waiting for input: "} + std::strerror(errno));
+        }
+        for (int i = 0; i < count; i++) {
+            auto &connection = *static_cast<Connection *>(events[i].data.ptr);
+            if (connection.fd < 0) {
+                continue;
+            }
+            if (connection.stream_scanner) {
+                _receiveStream(connection, on_frame, on_crc_error);
+            } else {
+                _receiveDatagrams(connection, on_frame, on_crc_error);
+            }
+        }
+        return _open_connections > 0;
+    }
+
+    /**
+     * @return when the frame passed to on_frame was received, in microseconds since the Unix epoch
+     */
+    [[nodiscard]] uint64_t receiveTime() const {
+        return _receive_time_us;
+    }
+
+    /**
+     * @return bytes outside of valid frames, in datagrams and on TCP connections
+     */
+    [[nodiscard]] uint64_t discardedBytes() const {
+        uint64_t discarded = _discarded_bytes;
+        for (const auto &connection : _connections) {
+            if (connection->stream_scanner) {
+                discarded += connection->stream_scanner->discardedBytes();
+            }
+        }
+        return discarded;
+    }
+
+    [[nodiscard]] const InputCounters &counters() const {
+        return _counters;
+    }
+
+    /**
+     * @return datagrams that did not fit into the receive buffer
+     */
+    [[nodiscard]] uint64_t truncatedDatagrams() const {
+        return _truncated_datagrams;
+    }
+};
+
+#endif //MAVTOOLS_LIVEINPUT_H
@@ -0,0 +1,205 @@
+/****************************************************************************
+ *
+ * Copyright (c) 2024, libmav development team
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name libmav nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+#ifndef MAVTOOLS_PIPELINEMETRICS_H
+#define MAVTOOLS_PIPELINEMETRICS_H
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "../common/Histogram.h"
+#include "../common/JsonWriter.h"
+#include "../common/OutputWriter.h"
+#include "LiveInput.h"
+
+/**
+ * Counters of the decoding thread. Only updated when metrics are enabled, so a disabled pipeline
+ * pays for one null check per frame.
+ */
+struct PipelineMetrics {
+    uint64_t frames = 0;
+    uint64_t crc_errors = 0;
+    uint64_t records = 0;
+    uint64_t record_bytes = 0;
+    Histogram format_ns;    // serializing one record, since the last report
+};
+
+/**
+ * Periodically publishes the pipeline metrics as one JSON line, to stderr or to every client
+ * connected to a local Unix socket. Slow clients are dropped instead of stalling the pipeline.
+ */
+class MetricsPublisher {
+private:
+    const std::chrono::steady_clock::duration _interval;
+    const std::chrono::steady_clock::time_point _start;
+    std::chrono::steady_clock::time_point _next;
+    std::string _socket_path;
+    int _listen_fd = -1;
+    std::vector<int> _clients;
+    JsonWriter _writer;
+
+    void _histogram(const char *key, const Histogram &histogram) {
+        _writer.raw(", \"").raw(key).raw("\": {\"count\": ").number(histogram.count());
+        _writer.raw(", \"mean\": ").number(histogram.mean());
+        _writer.raw(", \"p50\": ").number(histogram.quantile(0.5));
+        _writer.raw(", \"p99\": ").number(histogram.quantile(0.99));
+        _writer.raw(", \"max\": ").number(histogram.max()).raw('}');
+    }
+
+    void _send(std::string_view line) {
+        if (_listen_fd < 0) {
+            std::cerr << line << std::flush;
+            return;
+        }
+        int client;
+        while ((client = ::accept4(_listen_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+            _clients.push_back(client);
+        }
+        for (auto it = _clients.begin(); it != _clients.end();) {
+            ssize_t sent = ::send(*it, line.data(), line.size(), MSG_NOSIGNAL | MSG_DONTWAIT);
+            if (sent != static_cast<ssize_t>(line.size())) {
+                ::close(*it);
+                it = _clients.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+
+public:
+    /**
+     * @param socket_path where to listen for metrics clients, or empty for stderr
+     */
+    MetricsPublisher(std::chrono::steady_clock::duration interval, const std::string &socket_path) :
+            _interval(interval), _start(std::chrono::steady_clock::now()), _next(_start + interval),
+            _socket_path(socket_path) {
+        if (socket_path.empty()) {
+            return;
+        }
+        sockaddr_un address{};
+        address.sun_family = AF_UNIX;
+        if (socket_path.size() >= sizeof(address.sun_path)) {
+            throw std::invalid_argument("Socket path too long: " + socket_path);
+        }
+        std::memcpy(address.sun_path, socket_path.c_str(), socket_path.size() + 1);
+        // replace a stale socket from an earlier run, but never anything else
+        struct stat existing{};
+        if (::lstat(socket_path.c_str(), &existing) == 0) {
+            if (!S_ISSOCK(existing.st_mode)) {
+                throw std::runtime_error("Could not listen on " + socket_path + ": exists and is not a socket");
+            }
+            ::unlink(socket_path.c_str());
+        }
+        _listen_fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (_listen_fd < 0 || ::bind(_listen_fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0 ||
+                ::listen(_listen_fd, 8) != 0) {
+            std::string error = std::strerror(errno);
+            if (_listen_fd >= 0) {
+                ::close(_listen_fd);
+            }
+            throw std::runtime_error("Could not listen on " + socket_path + ": " + error);
+        }
+    }
+
+    MetricsPublisher(const MetricsPublisher &) = delete;
+    MetricsPublisher &operator=(const MetricsPublisher &) = delete;
+
+    ~MetricsPublisher() {
+        for (int client : _clients) {
+            ::close(client);
+        }
+        if (_listen_fd >= 0) {
+            ::close(_listen_fd);
+            ::unlink(_socket_path.c_str());
+        }
+    }
+
+    /**
+     * @return how long until the next report is due, at most limit
+     */
+    [[nodiscard]] std::chrono::milliseconds timeout(std::chrono::milliseconds limit) const {
+        auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(_next - std::chrono::steady_clock::now());
+        return std::max(std::min(remaining, limit), std::chrono::milliseconds(0));
+    }
+
+    /**
+     * Publishes a report if one is due, or always if force is set. Restarts the histograms after a report.
+     */
+    template<typename Input>
+    void publish(const Input &input, PipelineMetrics &metrics, OutputWriter &output, bool force = false) {
+        const auto now = std::chrono::steady_clock::now();
+        if (now < _next && !force) {
+            return;
+        }
+        while (_next <= now) {
+            _next += _interval;
+        }
+        const InputCounters &counters = input.counters();
+        OutputWriter::Statistics statistics = output.takeStatistics();
+
+        _writer.clear();
+        _writer.raw("{\"elapsed\": ").number(std::chrono::duration<double>(now - _start).count());
+        _writer.raw(", \"input\": {\"bytes\": ").number(counters.bytes);
+        _writer.raw(", \"reads\": ").number(counters.reads);
+        _writer.raw(", \"full_reads\": ").number(counters.full_reads);
+        _writer.raw(", \"discarded_bytes\": ").number(input.discardedBytes()).raw('}');
+        _writer.raw(", \"parse\": {\"frames\": ").number(metrics.frames);
+        _writer.raw(", \"crc_errors\": ").number(metrics.crc_errors).raw('}');
+        _writer.raw(", \"format\": {\"records\": ").number(metrics.records);
+        _writer.raw(", \"bytes\": ").number(metrics.record_bytes);
+        _histogram("ns", metrics.format_ns);
+        _writer.raw('}');
+        _writer.raw(", \"output\": {\"buffered_bytes\": ").number(statistics.buffered_bytes);
+        _writer.raw(", \"written_bytes\": ").number(statistics.written_bytes);
+        _writer.raw(", \"hand_offs\": ").number(statistics.hand_offs);
+        _histogram("producer_blocked_us", statistics.producer_blocked_us);
+        _histogram("write_us", statistics.write_us);
+        _writer.raw("}}\n");
+        metrics.format_ns = {};
+        _send(_writer.view());
+    }
+};
+
+#endif //MAVTOOLS_PIPELINEMETRICS_H
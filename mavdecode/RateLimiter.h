@@ -0,0 +1,256 @@
+/****************************************************************************
+ *
+ * Copyright (c) 2024, libmav development team
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name libmav nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+#ifndef MAVTOOLS_RATELIMITER_H
+#define MAVTOOLS_RATELIMITER_H
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "mav/MessageSet.h"
+#include "../common/Frame.h"
+
+/**
+ * Maximum rates per message type, as periods in microseconds. A period of 0 does not limit.
+ */
+class RateLimits {
+private:
+    const mav::MessageSet &_message_set;
+    std::unordered_map<uint32_t, uint64_t> _periods;
+    uint64_t _default_period_us = 0;
+
+    uint32_t parseMessage(const std::string &text, const std::string &spec) const {
+        auto definition = _message_set.getMessageDefinition(text);
+        if (definition.has_value()) {
+            return definition.get().id();
+        }
+        size_t parsed = 0;
+        int id = -1;
+        try {
+            id = std::stoi(text, &parsed);
+        } catch (std::logic_error &) {
+            parsed = 0;
+        }
+        if (parsed == 0 || parsed != text.size() || id < 0 || id > 0xFFFFFF) {
+            throw std::invalid_argument("Invalid rate limit: " + spec);
+        }
+        if (!_message_set.contains(id)) {
+            throw std::invalid_argument("Unknown message: " + text);
+        }
+        return static_cast<uint32_t>(id);
+    }
+
+    static uint64_t parsePeriod(const std::string &text, const std::string &spec) {
+        size_t parsed = 0;
+        double rate = -1;
+        try {
+            rate = std::stod(text, &parsed);
+        } catch (std::logic_error &) {
+            parsed = 0;
+        }
+        if (parsed == 0 || parsed != text.size() || !std::isfinite(rate) || rate < 0) {
+            throw std::invalid_argument("Invalid rate limit: " + spec);
+        }
+        return rate == 0 ? 0 : std::max<uint64_t>(static_cast<uint64_t>(std::llround(1e6 / rate)), 1);
+    }
+
+public:
+    explicit RateLimits(const mav::MessageSet &message_set) : _message_set(message_set) {}
+
+    /**
+     * Adds a limit of the form MSG=Hz, with a message name or id, or just Hz as the default for all messages
+     * without a limit of their own. A rate of 0 removes the limit.
+     * @throws std::invalid_argument if the limit can not be parsed
+     */
+    void add(const std::string &spec) {
+        const size_t equals = spec.find('=');
+        if (equals == std::string::npos) {
+            _default_period_us = parsePeriod(spec, spec);
+            return;
+        }
+        const uint32_t id = parseMessage(spec.substr(0, equals), spec);
+        _periods[id] = parsePeriod(spec.substr(equals + 1), spec);
+    }
+
+    [[nodiscard]] bool empty() const {
+        return _default_period_us == 0 &&
+               std::all_of(_periods.begin(), _periods.end(), [](const auto &period) { return period.second == 0; });
+    }
+
+    [[nodiscard]] uint64_t periodUs(uint32_t message_id) const {
+        auto period = _periods.find(message_id);
+        return period != _periods.end() ? period->second : _default_period_us;
+    }
+
+    /**
+     * @return the shortest limited period, which bounds how long a held back message waits
+     */
+    [[nodiscard]] std::chrono::microseconds shortestPeriod() const {
+        uint64_t shortest = _default_period_us;
+        for (const auto &period : _periods) {
+            if (period.second != 0 && (shortest == 0 || period.second < shortest)) {
+                shortest = period.second;
+            }
+        }
+        return std::chrono::microseconds(shortest);
+    }
+};
+
+/**
+ * Decimates messages to their rate limit, separately for every system and component. Within a period the latest
+ * message wins: it is held back until the period ends, replacing the one before it, so the output always carries
+ * the newest values. Only headers are looked at, dropped messages are never decoded.
+ */
+class RateLimiter {
+private:
+    struct Slot {
+        uint64_t period_us = 0;
+        uint64_t due_us = 0;
+        uint64_t pending_time_us = 0;
+        FrameView pending_frame;
+        std::vector<uint8_t> pending_data;
+        bool pending = false;
+        uint64_t received = 0;
+        uint64_t dropped = 0;
+    };
+
+    const mav::MessageSet &_message_set;
+    const RateLimits &_limits;
+    std::unordered_map<uint64_t, Slot> _slots;
+
+    static uint64_t slotKey(const FrameView &frame) {
+        return (static_cast<uint64_t>(frame.message_id) << 16) | (frame.system_id << 8) | frame.component_id;
+    }
+
+    Slot &_slot(const FrameView &frame) {
+        auto [it, inserted] = _slots.try_emplace(slotKey(frame));
+        if (inserted) {
+            it->second.period_us = _limits.periodUs(frame.message_id);
+        }
+        return it->second;
+    }
+
+    static void advance(Slot &slot, uint64_t time_us) {
+        // keep the cadence, unless the stream fell silent for longer than a period
+        slot.due_us += slot.period_us;
+        if (slot.due_us <= time_us) {
+            slot.due_us = time_us + slot.period_us;
+        }
+    }
+
+public:
+    RateLimiter(const mav::MessageSet &message_set, const RateLimits &limits) :
+            _message_set(message_set), _limits(limits) {}
+
+    /**
+     * Passes the frame to emit(frame, time_us) if its period is over, or holds a copy of it back for release().
+     */
+    template<typename Emit>
+    void offer(const FrameView &frame, uint64_t time_us, Emit &&emit) {
+        Slot &slot = _slot(frame);
+        slot.received++;
+        if (slot.period_us == 0) {
+            emit(frame, time_us);
+            return;
+        }
+        if (slot.pending) {
+            // replaced by a newer message, either held back in its place or passed right away
+            slot.dropped++;
+            slot.pending = false;
+        }
+        if (time_us >= slot.due_us) {
+            advance(slot, time_us);
+            emit(frame, time_us);
+            return;
+        }
+        slot.pending_data.assign(frame.data, frame.data + frame.size);
+        slot.pending_frame = frame;
+        slot.pending_frame.data = slot.pending_data.data();
+        slot.pending_time_us = time_us;
+        slot.pending = true;
+    }
+
+    /**
+     * Passes the held back frames whose period is over at time_us to emit(frame, time_us), with the time they
+     * were offered at.
+     */
+    template<typename Emit>
+    void release(uint64_t time_us, Emit &&emit) {
+        for (auto &[key, slot] : _slots) {
+            if (slot.pending && time_us >= slot.due_us) {
+                slot.pending = false;
+                advance(slot, time_us);
+                emit(static_cast<const FrameView &>(slot.pending_frame), slot.pending_time_us);
+            }
+        }
+    }
+
+    /**
+     * @return one line per message type that dropped messages, with the counts of all its sources
+     */
+    [[nodiscard]] std::string report() const {
+        struct Counts {
+            uint64_t received = 0;
+            uint64_t dropped = 0;
+            uint64_t period_us = 0;
+        };
+        std::map<uint32_t, Counts> counts;
+        for (const auto &[key, slot] : _slots) {
+            if (slot.dropped > 0) {
+                Counts &message = counts[static_cast<uint32_t>(key >> 16)];
+                message.received += slot.received;
+                message.dropped += slot.dropped;
+                message.period_us = slot.period_us;
+            }
+        }
+        std::ostringstream report;
+        for (const auto &[id, message] : counts) {
+            auto definition = _message_set.getMessageDefinition(static_cast<int>(id));
+            report << "Rate limited " << (definition.has_value() ? definition.get().name() : "id_" + std::to_string(id))
+                   << " to " << 1e6 / static_cast<double>(message.period_us) << " Hz: dropped " << message.dropped
+                   << " of " << message.received << "\n";
+        }
+        return report.str();
+    }
+};
+
+#endif //MAVTOOLS_RATELIMITER_H
@@ -32,14 +32,29 @@
  *
  ****************************************************************************/
 
+#include <algorithm>
 #include <iostream>
+#include <limits>
+#include <optional>
 #include <thread>
 #include <atomic>
 #include <csignal>
+#include <functional>
+#include <cstring>
+#include <sstream>
+#include <fcntl.h>
+#include <unistd.h>
 #include "args/args.hxx"
 
-#include "../common/DummyInterface.h"
+#include "../common/MappedFile.h"
+#include "../common/OutputWriter.h"
 #include "../common/builtinMessageSet.h"
+#include "ColumnExport.h"
+#include "Demultiplexer.h"
+#include "FileDecoder.h"
+#include "LinkStatistics.h"
+#include "LiveInput.h"
+#include "PipelineMetrics.h"
 
 
 namespace {
@@ -56,70 +71,144 @@ namespace {
     }
 }
 
-template<typename T>
-std::string jsonStringifyNumber(const T &arg) {
-    if constexpr (std::is_floating_point<T>::value) {
-        std::stringstream ss;
-        if (std::isnan(arg)) {
-            ss << "\"NaN\""; // JSON does not support NaN, so we print it as a string
-        } else if (std::isinf(arg) && arg > 0) {
-            ss << "\"Infinity\""; // JSON does not support Infinity, so we print it as a string
-        } else if (std::isinf(arg) && arg < 0) {
-            ss << "\"-Infinity\""; // JSON does not support -Infinity, so we print it as a string
-        } else {
-            ss << arg;
+template<typename Input>
+void runStatistics(const DecodeOptions &options, Input &input, std::chrono::milliseconds interval,
+                   std::chrono::duration<double> window, const std::atomic_bool &interrupted, OutputWriter &output) {
+    LinkStatistics statistics{options.message_set};
+
+    auto on_frame = [&options, &statistics](const FrameView &frame) {
+        statistics.onFrame(frame, options.filter.accepts(frame));
+    };
+    auto on_crc_error = [&options, &statistics](const FrameView &frame) {
+        if (options.filter.accepts(frame)) {
+            statistics.onCrcError(frame);
+        }
+    };
+
+    auto next_report = std::chrono::steady_clock::now() + interval;
+    bool eof = false;
+    while (!eof && !interrupted.load()) {
+        // wake up for the next report, even if the link is silent
+        auto timeout = std::chrono::duration_cast<std::chrono::milliseconds>(next_report - std::chrono::steady_clock::now());
+        eof = !input.poll(timeout, on_frame, on_crc_error);
+        if (std::chrono::steady_clock::now() >= next_report) {
+            output.write(statistics.report(window, input.discardedBytes()));
+            next_report += interval;
         }
-        return ss.str();
-    } else if constexpr (mav::is_any<std::decay_t<T>, uint8_t, int8_t>::value) {
-        // static cast to int to avoid printing as a char
-        return std::to_string(static_cast<int>(arg));
-    } else {
-        return std::to_string(arg);
     }
+    output.write(statistics.report(window, input.discardedBytes()));
 }
 
-std::string jsonStringifyNativeType(const mav::NativeVariantType &value) {
-    std::stringstream ss;
-    std::visit([&ss](auto&& arg) {
-        if constexpr (mav::is_string<decltype(arg)>::value) {
-            ss << "\"" << arg << "\"";
-        } else if constexpr (mav::is_iterable<decltype(arg)>::value) {
-            ss << "[";
-            for (auto it = arg.begin(); it != arg.end(); it++) {
-                if (it != arg.begin())
-                    ss << ", ";
-                ss << jsonStringifyNumber(*it);
-            }
-            ss << "]";
+/**
+ * Decodes frames as they arrive. If recording is set, every valid frame is also written to it as a tlog record,
+ * including the ones that are filtered out. If publisher is set, the pipeline is instrumented and reports
+ * are published periodically. If demultiplexer is set, records go to its outputs instead of output, and if
+ * columns is set, the accepted messages are collected into its columns instead of being formatted. Rate limits
+ * in the options decimate the accepted messages before either happens.
+ */
+template<typename Input>
+void runLive(const DecodeOptions &options, Input &input, const std::atomic_bool &interrupted, OutputWriter &output,
+             OutputWriter *recording, MetricsPublisher *publisher, Demultiplexer *demultiplexer = nullptr,
+             ColumnExporter *columns = nullptr) {
+    RecordFormatter formatter{options};
+    PipelineMetrics metrics;
+    PipelineMetrics *measured = publisher ? &metrics : nullptr;
+    std::unique_ptr<RateLimiter> limiter;
+    if (!options.rate_limits.empty()) {
+        limiter = std::make_unique<RateLimiter>(options.message_set, options.rate_limits);
+    }
+    uint64_t frame_index = 0;
+    bool range_done = false;
+
+    // formats accepted messages, or collects them into columns
+    auto deliver = [&](const FrameView &frame, uint64_t timestamp_us) {
+        if (columns) {
+            columns->add(frame, timestamp_us);
+            return;
+        }
+        const auto start = measured ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point{};
+        auto record = formatter.formatFrame(frame, timestamp_us);
+        if (measured) {
+            measured->format_ns.add(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now() - start).count());
+            measured->records++;
+            measured->record_bytes += record.size();
+        }
+        if (record.empty()) {
+            return;
+        }
+        if (demultiplexer) {
+            demultiplexer->write(frame, record);
         } else {
-            ss << jsonStringifyNumber(arg);
+            output.write(record);
         }
-    }, value);
-    return ss.str();
-}
+    };
 
-std::string messageAsJson(const mav::Message &message) {
-    std::stringstream ss;
-    ss << "{";
-    ss << "\"id\": " << message.id() << ", ";
-    ss << "\"name\": \"" << message.name() << "\", ";
-    ss << "\"system_id\": " << static_cast<int>(message.header().systemId()) << ", ";
-    ss << "\"component_id\": " << static_cast<int>(message.header().componentId()) << ", ";
-    ss << "\"seq\": " << static_cast<int>(message.header().isSigned()) << ", ";
-    ss << "\"fields\": { ";
-    for (const auto &field : message.type().fieldNames()) {
-        ss << "\"" << field << "\":";
-        auto field_value = message.getAsNativeTypeInVariant(field);
-        ss << jsonStringifyNativeType(field_value);
-        if (field != message.type().fieldNames().back()) {
-            ss << ",";
+    auto on_frame = [&](const FrameView &frame) {
+        if (recording) {
+            auto timestamp = encodeTlogTimestamp(input.receiveTime());
+            recording->write(std::string_view{timestamp.data(), timestamp.size()});
+            recording->write(std::string_view{reinterpret_cast<const char *>(frame.data), frame.size});
+        }
+        if (measured) {
+            measured->frames++;
+        }
+        const uint64_t index = frame_index++;
+        if (options.messages && !options.messages->contains(index)) {
+            range_done = index >= options.messages->to;
+            return;
+        }
+        if (!formatter.accepts(frame.message_id, frame.system_id, frame.component_id)) {
+            return;
+        }
+        if (limiter) {
+            limiter->offer(frame, input.receiveTime(), deliver);
         } else {
-            ss << "";
+            deliver(frame, input.receiveTime());
         }
+    };
+    auto on_crc_error = [measured](const FrameView &) {
+        if (measured) {
+            measured->crc_errors++;
+        }
+    };
+
+    // held back messages are released on the receive clock, which keeps running while the input is quiet
+    uint64_t arrived_frames = 0;
+    auto last_arrival = std::chrono::steady_clock::now();
+
+    if (publisher) {
+        output.enableStatistics();
+    }
+    // the timeout only bounds how long an interrupt goes unnoticed, or until the next report or release
+    std::chrono::milliseconds timeout{100};
+    if (limiter) {
+        timeout = std::clamp(std::chrono::duration_cast<std::chrono::milliseconds>(
+                options.rate_limits.shortestPeriod()), std::chrono::milliseconds{1}, timeout);
+    }
+    while (!interrupted.load() && !range_done &&
+            input.poll(publisher ? publisher->timeout(timeout) : timeout, on_frame, on_crc_error)) {
+        if (limiter) {
+            const auto now = std::chrono::steady_clock::now();
+            if (frame_index != arrived_frames) {
+                arrived_frames = frame_index;
+                last_arrival = now;
+            }
+            const auto quiet = std::chrono::duration_cast<std::chrono::microseconds>(now - last_arrival);
+            limiter->release(input.receiveTime() + quiet.count(), deliver);
+        }
+        if (publisher) {
+            publisher->publish(input, metrics, output);
+        }
+    }
+    if (limiter) {
+        // the latest values are never lost, even if their period is not over yet
+        limiter->release(std::numeric_limits<uint64_t>::max(), deliver);
+        std::cerr << limiter->report();
+    }
+    if (publisher) {
+        publisher->publish(input, metrics, output, true);
     }
-    ss << "}";
-    ss << "}";
-    return ss.str();
 }
 
 
@@ -128,6 +217,36 @@ int main(int argc, char *argv[]) {
     args::ArgumentParser parser("mavdecode");
     args::HelpFlag help(parser, "help", "Display this help menu", {'h', "help"});
     args::ValueFlag<std::string> xml_file(parser, "message_set", "Mavlink message set XML to be used", {'x', "xml"});
+    args::ValueFlag<std::string> flush_policy(parser, "policy", "When to write decoded output: message, interval or full. Defaults to full for files and interval otherwise.", {"flush"});
+    args::ValueFlag<int> flush_interval(parser, "ms", "Flush interval in milliseconds for the interval flush policy", {"flush-interval"}, 50);
+    args::ValueFlagList<std::string> include(parser, "selector", "Only decode matching messages. Comma separated message names or ids, sysid=<n> or compid=<n>.", {'i', "include"});
+    args::ValueFlagList<std::string> exclude(parser, "selector", "Skip matching messages. Same syntax as --include.", {'e', "exclude"});
+    args::ValueFlagList<std::string> fields(parser, "fields", "Only output the given fields. Comma separated MSG.field pairs, other messages are skipped.", {'f', "fields"});
+    args::ValueFlag<std::string> format(parser, "format", "Output format: json, csv, tsv, cbor, msgpack or raw. csv and tsv require --fields. raw copies the selected frames unchanged, as tlog records with --timestamps.", {"format"}, "json");
+    args::Flag stats(parser, "stats", "Only parse headers, and periodically print message rates, bandwidth, checksum errors and sequence gaps per stream", {"stats"});
+    args::ValueFlag<double> stats_interval(parser, "seconds", "Interval between statistics reports", {"stats-interval"}, 1.0);
+    args::ValueFlag<double> stats_window(parser, "seconds", "Sliding window for the rates in statistics reports", {"stats-window"}, 5.0);
+    args::ValueFlag<int> threads(parser, "threads", "Number of threads decoding a file input in parallel. 0 uses all cores.", {'j', "threads"}, 1);
+    args::ValueFlagList<std::string> udp(parser, "host:port", "Receive UDP datagrams on a local address, e.g. :14550. Can be repeated.", {"udp"});
+    args::ValueFlagList<std::string> tcp(parser, "host:port", "Connect to a TCP server, e.g. localhost:5760. Can be repeated.", {"tcp"});
+    args::Flag timestamps(parser, "timestamps", "Add the receive time of every message, in microseconds since the Unix epoch", {"timestamps"});
+    args::Flag tlog(parser, "tlog", "The input is a tlog capture, where every frame is preceded by its receive time", {"tlog"});
+    args::ValueFlag<std::string> record_file(parser, "file", "Also record all received frames with their receive time to a tlog file", {"record"});
+    args::Flag metrics(parser, "metrics", "Periodically print pipeline metrics to stderr: bytes read, frames, errors, formatting time and output stalls", {"metrics"});
+    args::ValueFlag<std::string> metrics_socket(parser, "path", "Publish the pipeline metrics on a local Unix socket instead of stderr", {"metrics-socket"});
+    args::ValueFlag<double> metrics_interval(parser, "seconds", "Interval between pipeline metrics reports", {"metrics-interval"}, 1.0);
+    args::ValueFlag<std::string> bytes(parser, "from:to", "Only decode the frames within this byte range of a capture file, e.g. 1G:2G", {"bytes"});
+    args::ValueFlag<std::string> messages(parser, "from:to", "Only decode the frames with an index in this range, counting all valid frames of the input", {"messages"});
+    args::ValueFlag<std::string> split(parser, "key", "Split the decoded output into one file per sysid, source (sysid and compid) or message", {"split"});
+    args::ValueFlag<std::string> split_dir(parser, "dir", "Directory for the --split output files", {"split-dir"}, ".");
+    args::ValueFlag<int> max_open_files(parser, "n", "Maximum number of --split output files kept open at once", {"max-open-files"}, 256);
+    args::ValueFlag<std::string> columns(parser, "dir", "Export the fields of every message type as columns, to one .mcol file per message type in this directory", {"columns"});
+    args::Flag build_index(parser, "build-index", "Build a sidecar index of a capture file, used by --from, --to and --msg", {"build-index"});
+    args::ValueFlag<uint32_t> index_interval(parser, "frames", "Number of frames per block of the index", {"index-interval"}, 4096);
+    args::ValueFlag<double> from_time(parser, "seconds", "With an index, start at this boot time. Negative values count back from the end of the capture.", {"from"});
+    args::ValueFlag<double> to_time(parser, "seconds", "With an index, stop after this boot time. Negative values count back from the end of the capture.", {"to"});
+    args::ValueFlagList<std::string> msg(parser, "messages", "With an index, only decode these messages, seeking to where they occur. Comma separated message names or ids.", {"msg"});
+    args::ValueFlagList<std::string> max_rate(parser, "MSG=Hz", "Decimate a message type to at most this rate per system and component, keeping the latest message of every period. A rate without MSG is the default for all types, and 0 removes a limit. Needs live input or --tlog.", {"max-rate"});
     args::Positional<std::string> input_file(parser, "file", "Binary file containing mavlink messages to decode. Reads stdin when set to - or not set.", args::Options::Single);
 
     try {
@@ -151,68 +270,374 @@ int main(int argc, char *argv[]) {
         loadBuiltinMessageSet(message_set);
     }
 
-    std::shared_ptr<std::istream> input_stream;
-    if (!input_file || args::get(input_file) == "-") {
-        std::cerr << "Reading from stdin" << std::endl;
-        input_stream = std::shared_ptr<std::istream>(&std::cin, [](std::istream *) {});
-    } else {
-        std::cerr << "Reading from file: " << args::get(input_file) << std::endl;
-        input_stream = std::make_shared<std::ifstream>(args::get(input_file), std::ios::binary);
+    DecodeOptions options{message_set};
+    try {
+        for (const auto &selector : args::get(include)) {
+            options.filter.include(selector, message_set);
+        }
+        for (const auto &selector : args::get(exclude)) {
+            options.filter.exclude(selector, message_set);
+        }
+        for (const auto &projection : args::get(fields)) {
+            options.projection.add(projection, message_set);
+        }
+        for (const auto &limit : args::get(max_rate)) {
+            options.rate_limits.add(limit);
+        }
+    } catch (std::invalid_argument &e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    // only projected messages have output, so drop everything else on the header already
+    for (const auto *plan : options.projection.plans()) {
+        options.filter.include(plan->definition->name(), message_set);
+    }
+
+    auto output_format = parseOutputFormat(args::get(format));
+    if (!output_format) {
+        std::cerr << "Unknown output format: " << args::get(format) << std::endl;
+        return 1;
     }
+    if (*output_format == OutputFormat::RAW && !options.projection.empty()) {
+        std::cerr << "Raw output copies whole frames, and can not be combined with --fields" << std::endl;
+        return 1;
+    }
+    if ((*output_format == OutputFormat::CSV || *output_format == OutputFormat::TSV) && options.projection.empty()) {
+        std::cerr << "Output format " << args::get(format) << " requires --fields" << std::endl;
+        return 1;
+    }
+    options.format = *output_format;
 
-    DummyInterface dummy_interface;
-    mav::StreamParser streamParser{message_set, dummy_interface};
+    std::optional<OutputWriter::FlushPolicy> policy;
+    if (flush_policy) {
+        policy = OutputWriter::parseFlushPolicy(args::get(flush_policy));
+        if (!policy) {
+            std::cerr << "Unknown flush policy: " << args::get(flush_policy) << std::endl;
+            return 1;
+        }
+    }
+    const std::chrono::milliseconds interval{args::get(flush_interval)};
 
     std::atomic_bool interrupted{false};
-    std::unique_ptr<std::thread> parser_thread;
     int retval = 0;
-
-    auto signal_handler = [&](int signal) {
+    signalHandlerImpl = [&](int signal) {
         interrupted.store(true);
         retval = signal;
-        dummy_interface.stop();
-        // set the eof bit on cin to stop the input loop
-        if (input_stream.get() == &std::cin) {
-            std::cin.setstate(std::ios::eofbit);
-            std::fclose(stdin);
-        }
     };
-    signalHandlerImpl = signal_handler;
 
-    parser_thread = std::make_unique<std::thread>([&streamParser] {
-        bool should_stop = false;
-        while (!should_stop) {
+    const bool from_stdin = !input_file || args::get(input_file) == "-";
+    const bool network = udp || tcp;
+    if (network && !from_stdin) {
+        std::cerr << "A file input can not be combined with --udp or --tcp" << std::endl;
+        return 1;
+    }
+    options.timestamps = static_cast<bool>(timestamps);
+
+    std::optional<IndexRange> byte_range;
+    try {
+        if (bytes) {
+            byte_range = IndexRange::parse(args::get(bytes));
+        }
+        if (messages) {
+            options.messages = IndexRange::parse(args::get(messages));
+        }
+    } catch (std::invalid_argument &e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+
+    std::optional<SplitKey::Kind> split_kind;
+    if (split) {
+        split_kind = SplitKey::parse(args::get(split));
+        if (!split_kind) {
+            std::cerr << "Unknown split key: " << args::get(split) << std::endl;
+            return 1;
+        }
+        if (stats) {
+            std::cerr << "--split can not be combined with --stats" << std::endl;
+            return 1;
+        }
+    }
+    if (stats && !options.rate_limits.empty()) {
+        std::cerr << "--max-rate can not be combined with --stats" << std::endl;
+        return 1;
+    }
+    if (columns && (split || stats || format)) {
+        std::cerr << "--columns has its own format, and can not be combined with --split, --stats or --format" << std::endl;
+        return 1;
+    }
+
+    const bool indexed = from_time || to_time || msg;
+    if ((build_index || indexed) && (from_stdin || network || stats || split || columns || tlog || metrics ||
+            metrics_socket || !MappedFile::isRegularFile(args::get(input_file)))) {
+        std::cerr << "--build-index, --from, --to and --msg need a capture file as input, and can not be combined with "
+                     "--stats, --split, --columns, --tlog or --metrics" << std::endl;
+        return 1;
+    }
+    if (indexed && (byte_range || options.messages)) {
+        std::cerr << "--from, --to and --msg can not be combined with --bytes or --messages" << std::endl;
+        return 1;
+    }
+
+    // read times of a capture file are meaningless, whichever path it takes
+    const bool capture_file = !network && !from_stdin && !tlog && MappedFile::isRegularFile(args::get(input_file));
+    if (capture_file && (timestamps || record_file)) {
+        std::cerr << "Capture files have no receive times, --timestamps and --record need live input or --tlog" << std::endl;
+        return 1;
+    }
+    if (capture_file && !options.rate_limits.empty()) {
+        std::cerr << "Capture files have no receive times, --max-rate needs live input or --tlog" << std::endl;
+        return 1;
+    }
+
+    // regular files are mapped and parsed in place, without a reader thread
+    if (capture_file && !stats && !metrics && !metrics_socket && !split && !columns) {
+        std::cerr << "Reading from file: " << args::get(input_file) << std::endl;
+        std::optional<MappedFile> mapped_file;
+        try {
+            mapped_file.emplace(args::get(input_file));
+        } catch (std::runtime_error &e) {
+            std::cerr << e.what() << std::endl;
+            return 1;
+        }
+        if (build_index) {
+            const int index_threads = args::get(threads) > 0 ?
+                    args::get(threads) : static_cast<int>(std::thread::hardware_concurrency());
+            CaptureIndex index{args::get(index_interval)};
+            IndexBuilder{message_set, index_threads}.build(mapped_file->data(), mapped_file->size(), index, interrupted);
+            if (interrupted.load()) {
+                return retval;
+            }
+            try {
+                index.save(args::get(input_file));
+            } catch (std::exception &e) {
+                std::cerr << e.what() << std::endl;
+                return 1;
+            }
+            std::cerr << "Indexed " << index.frames() << " frames in " << index.blocks().size() << " blocks to "
+                      << CaptureIndex::pathFor(args::get(input_file)) << std::endl;
+            return retval;
+        }
+        if (indexed) {
+            std::optional<CaptureIndex> index;
+            std::vector<uint32_t> message_ids;
+            std::optional<int64_t> from_ms;
+            std::optional<int64_t> to_ms;
             try {
-                auto message = streamParser.next();
-                std::cout << messageAsJson(message) << std::endl;
-            } catch (mav::NetworkInterfaceInterrupt &e) {
-                should_stop = true;
-            } catch (mav::NetworkError &e) {
-                std::cerr << "Network error: " << e.what() << std::endl;
+                index = CaptureIndex::load(args::get(input_file));
+                for (const auto &selector : args::get(msg)) {
+                    options.filter.include(selector, message_set);
+                    std::stringstream names{selector};
+                    std::string name;
+                    while (std::getline(names, name, ',')) {
+                        if (name.empty()) {
+                            continue;
+                        }
+                        auto definition = message_set.getMessageDefinition(name);
+                        message_ids.push_back(definition.has_value() ? static_cast<uint32_t>(definition.get().id()) :
+                                              static_cast<uint32_t>(std::stoul(name)));
+                    }
+                }
+                const int64_t last_time = index->lastTime();
+                auto boot_time = [last_time](double seconds) -> int64_t {
+                    if (seconds >= 0) {
+                        return static_cast<int64_t>(seconds * 1000);
+                    }
+                    if (last_time == FrameClock::NO_TIME) {
+                        throw std::invalid_argument("The capture has no boot times to count back from");
+                    }
+                    return last_time + static_cast<int64_t>(seconds * 1000);
+                };
+                if (from_time) {
+                    from_ms = boot_time(args::get(from_time));
+                }
+                if (to_time) {
+                    to_ms = boot_time(args::get(to_time));
+                }
+            } catch (std::exception &e) {
+                std::cerr << e.what() << std::endl;
+                return 1;
+            }
+            const auto regions = index->select(message_ids, from_ms, to_ms);
+            OutputWriter output{STDOUT_FILENO, policy.value_or(OutputWriter::FlushPolicy::FULL), interval};
+            output.write(RecordFormatter{options}.preamble());
+            IndexedDecoder decoder{options, from_ms, to_ms};
+            decoder.decode(mapped_file->data(), mapped_file->size(), regions, interrupted, [&output](std::string_view record) {
+                output.write(record);
+            });
+            return retval;
+        }
+        // a byte range simply narrows the mapping, so only frames lying completely inside it are found
+        const uint8_t *data = mapped_file->data();
+        size_t size = mapped_file->size();
+        if (byte_range) {
+            const size_t from = std::min<uint64_t>(byte_range->from, size);
+            data += from;
+            size = std::min<uint64_t>(byte_range->to, size) - from;
+        }
+        OutputWriter output{STDOUT_FILENO, policy.value_or(OutputWriter::FlushPolicy::FULL), interval};
+        output.write(RecordFormatter{options}.preamble());
+
+        int thread_count = args::get(threads) > 0 ?
+                args::get(threads) : static_cast<int>(std::thread::hardware_concurrency());
+        if (options.messages && thread_count > 1) {
+            // message indices are counted from the start, which needs a single pass
+            thread_count = 1;
+        }
+        if (thread_count > 1) {
+            std::cerr << "Decoding with " << thread_count << " threads" << std::endl;
+            ParallelFileDecoder decoder{options, thread_count};
+            decoder.decode(data, size, output, interrupted);
+        } else {
+            RangeDecoder decoder{options};
+            if (options.format == OutputFormat::RAW && !options.timestamps) {
+                // raw records point into the mapping, so runs of adjacent frames are written in one piece
+                constexpr size_t RAW_RUN_SIZE = 1024 * 1024;
+                std::string_view run;
+                decoder.decode(data, 0, size, size, interrupted,
+                               [&output, &run](size_t, size_t, std::string_view record) {
+                    if (record.empty()) {
+                        return;
+                    }
+                    if (run.data() + run.size() == record.data() && run.size() < RAW_RUN_SIZE) {
+                        run = std::string_view{run.data(), run.size() + record.size()};
+                        return;
+                    }
+                    output.write(run);
+                    run = record;
+                });
+                output.write(run);
+            } else {
+                decoder.decode(data, 0, size, size, interrupted,
+                               [&output](size_t, size_t, std::string_view record) {
+                    if (!record.empty()) {
+                        output.write(record);
+                    }
+                });
             }
         }
-    });
+        return retval;
+    }
 
-    // read in chunks of 64 bytes until EOF
-    char buffer[64];
-    while (input_stream->read(buffer, sizeof(buffer)) && !interrupted.load()) {
-        std::streamsize bytesRead = input_stream->gcount();
-        dummy_interface.addToReceiveQueue(std::string(buffer, bytesRead));
+    if (byte_range) {
+        std::cerr << "--bytes needs a capture file as input" << std::endl;
+        return 1;
     }
 
-    // Handle any remaining bytes after the last read
-    if (input_stream->gcount() > 0 && !interrupted.load()) {
-        dummy_interface.addToReceiveQueue(std::string(buffer, input_stream->gcount()));
+    int record_fd = -1;
+    if (record_file) {
+        record_fd = ::open(args::get(record_file).c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (record_fd < 0) {
+            std::cerr << "Could not open " << args::get(record_file) << ": " << std::strerror(errno) << std::endl;
+            return 1;
+        }
+        std::cerr << "Recording to: " << args::get(record_file) << std::endl;
     }
 
-    if (!interrupted.load()) { // make sure we parse everything, if we are not interrupted
-        dummy_interface.waitUntilReceiveQueueEmpty();
+    std::unique_ptr<MetricsPublisher> publisher;
+    if (metrics || metrics_socket) {
+        if (stats) {
+            std::cerr << "Pipeline metrics are only available when decoding" << std::endl;
+        } else {
+            const auto metrics_period = std::chrono::milliseconds(static_cast<int64_t>(args::get(metrics_interval) * 1000));
+            try {
+                publisher = std::make_unique<MetricsPublisher>(std::max(metrics_period, std::chrono::milliseconds(1)),
+                                                               metrics_socket ? args::get(metrics_socket) : "");
+            } catch (std::exception &e) {
+                std::cerr << e.what() << std::endl;
+                return 1;
+            }
+        }
     }
-    dummy_interface.stop();
-    if (parser_thread->joinable()) {
-        parser_thread->join();
+
+    auto run = [&](auto &input) {
+        std::unique_ptr<OutputWriter> recording;
+        if (record_fd >= 0) {
+            recording = std::make_unique<OutputWriter>(record_fd, OutputWriter::FlushPolicy::INTERVAL, interval);
+        }
+        if (stats) {
+            OutputWriter output{STDOUT_FILENO, policy.value_or(OutputWriter::FlushPolicy::MESSAGE), interval};
+            const auto report_interval = std::chrono::milliseconds(static_cast<int64_t>(args::get(stats_interval) * 1000));
+            runStatistics(options, input, std::max(report_interval, std::chrono::milliseconds(1)),
+                          std::chrono::duration<double>(args::get(stats_window)), interrupted, output);
+        } else if (columns) {
+            // every message type is a table, with its batches written like split output
+            OutputWriter output{STDOUT_FILENO, policy.value_or(OutputWriter::FlushPolicy::INTERVAL), interval};
+            SplitKey split_key{SplitKey::Kind::MESSAGE, message_set};
+            const int writers = args::get(threads) > 0 ?
+                    args::get(threads) : static_cast<int>(std::thread::hardware_concurrency());
+            Demultiplexer demultiplexer{split_key, args::get(columns), ".mcol", {}, writers,
+                                        static_cast<size_t>(std::max(args::get(max_open_files), 1))};
+            ColumnExporter exporter{options, demultiplexer};
+            runLive(options, input, interrupted, output, recording.get(), publisher.get(), nullptr, &exporter);
+            exporter.flush();
+            demultiplexer.close();
+            std::cerr << "Wrote " << demultiplexer.outputs() << " column files to " << args::get(columns) << std::endl;
+        } else if (split_kind) {
+            // every output file gets its own buffer, the writer threads only share the open file limit
+            OutputWriter output{STDOUT_FILENO, policy.value_or(OutputWriter::FlushPolicy::INTERVAL), interval};
+            SplitKey split_key{*split_kind, message_set};
+            const int writers = args::get(threads) > 0 ?
+                    args::get(threads) : static_cast<int>(std::thread::hardware_concurrency());
+            Demultiplexer demultiplexer{split_key, args::get(split_dir), outputExtension(options),
+                                        RecordFormatter{options}.preambles(), writers,
+                                        static_cast<size_t>(std::max(args::get(max_open_files), 1))};
+            runLive(options, input, interrupted, output, recording.get(), publisher.get(), &demultiplexer);
+            demultiplexer.close();
+            std::cerr << "Wrote " << demultiplexer.outputs() << " files to " << args::get(split_dir) << std::endl;
+        } else {
+            OutputWriter output{STDOUT_FILENO, policy.value_or(OutputWriter::FlushPolicy::INTERVAL), interval};
+            output.write(RecordFormatter{options}.preamble());
+            runLive(options, input, interrupted, output, recording.get(), publisher.get());
+        }
+        if (recording) {
+            recording->close();
+            ::close(record_fd);
+        }
+    };
+
+    if (network) {
+        NetworkInput input{message_set};
+        try {
+            for (const auto &endpoint : args::get(udp)) {
+                input.addUdp(endpoint);
+                std::cerr << "Listening on udp " << endpoint << std::endl;
+            }
+            for (const auto &endpoint : args::get(tcp)) {
+                input.addTcp(endpoint);
+                std::cerr << "Connected to tcp " << endpoint << std::endl;
+            }
+        } catch (std::exception &e) {
+            std::cerr << e.what() << std::endl;
+            return 1;
+        }
+        run(input);
+        if (input.truncatedDatagrams() > 0) {
+            std::cerr << "Truncated datagrams: " << input.truncatedDatagrams() << std::endl;
+        }
+        return retval;
     }
 
+    int fd = STDIN_FILENO;
+    if (from_stdin) {
+        std::cerr << "Reading from stdin" << std::endl;
+    } else {
+        std::cerr << "Reading from file: " << args::get(input_file) << std::endl;
+        fd = ::open(args::get(input_file).c_str(), O_RDONLY);
+        if (fd < 0) {
+            std::cerr << "Could not open " << args::get(input_file) << ": " << std::strerror(errno) << std::endl;
+            return 1;
+        }
+    }
+    if (tlog) {
+        TlogInput input{message_set, fd};
+        run(input);
+    } else {
+        DescriptorInput input{message_set, fd};
+        run(input);
+    }
+    if (fd != STDIN_FILENO) {
+        ::close(fd);
+    }
     return retval;
 }
-
@@ -0,0 +1,530 @@
+/****************************************************************************
+ *
+ * Copyright (c) 2024, libmav development team
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name libmav nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+#ifndef MAVTOOLS_BINARYRECORDPARSER_H
+#define MAVTOOLS_BINARYRECORDPARSER_H
+
+#include <atomic>
+#include <cerrno>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include "../common/BinaryWriter.h"
+#include "RecordParser.h"
+
+enum class InputFormat {
+    JSON,
+    CBOR,
+    MSGPACK
+};
+
+inline std::optional<InputFormat> parseInputFormat(const std::string &name) {
+    if (name == "json") {
+        return InputFormat::JSON;
+    } else if (name == "cbor") {
+        return InputFormat::CBOR;
+    } else if (name == "msgpack") {
+        return InputFormat::MSGPACK;
+    }
+    return std::nullopt;
+}
+
+/**
+ * Reads one CBOR or MessagePack record at a time, as written by mavdecode, and replays it to a MessageBuilder
+ * as the events of the equivalent JSON record. Typed arrays become arrays of their elements, byte strings
+ * arrays of uint8 values. Values without a JSON equivalent, such as unknown typed arrays, are passed on as null.
+ */
+class BinaryRecordReader {
+public:
+    enum class Status {
+        COMPLETE,
+        INCOMPLETE,     // the input ends within the record
+        INVALID
+    };
+
+private:
+    // records are two levels deep, anything far deeper is garbage
+    static constexpr int MAX_DEPTH = 16;
+
+    const InputFormat _format;
+    MessageBuilder &_builder;
+    const uint8_t *_position = nullptr;
+    const uint8_t *_end = nullptr;
+    Status _status = Status::COMPLETE;
+    // strings are passed on zero terminated
+    std::string _text;
+
+    bool _fail(Status status) {
+        _status = status;
+        return false;
+    }
+
+    bool _take(size_t size, const uint8_t *&data) {
+        if (static_cast<size_t>(_end - _position) < size) {
+            return _fail(Status::INCOMPLETE);
+        }
+        data = _position;
+        _position += size;
+        return true;
+    }
+
+    bool _byte(uint8_t &value) {
+        const uint8_t *data;
+        if (!_take(1, data)) {
+            return false;
+        }
+        value = *data;
+        return true;
+    }
+
+    template<typename T>
+    bool _bigEndian(T &value) {
+        const uint8_t *data;
+        if (!_take(sizeof(T), data)) {
+            return false;
+        }
+        uint64_t bits = 0;
+        for (size_t i = 0; i < sizeof(T); i++) {
+            bits = bits << 8 | data[i];
+        }
+        if constexpr (std::is_floating_point_v<T>) {
+            using Bits = std::conditional_t<sizeof(T) == 4, uint32_t, uint64_t>;
+            auto narrow = static_cast<Bits>(bits);
+            std::memcpy(&value, &narrow, sizeof(T));
+        } else {
+            value = static_cast<T>(bits);
+        }
+        return true;
+    }
+
+    bool _integer(uint64_t value) {
+        // like rapidjson, only values beyond int64 are passed as uint64
+        if (value > static_cast<uint64_t>(INT64_MAX)) {
+            return _builder.Uint64(value);
+        }
+        return _builder.Int64(static_cast<int64_t>(value));
+    }
+
+    bool _string(const uint8_t *data, size_t size) {
+        _text.assign(reinterpret_cast<const char *>(data), size);
+        return _builder.String(_text.c_str(), static_cast<rapidjson::SizeType>(size), true);
+    }
+
+    bool _key(const uint8_t *data, size_t size) {
+        _text.assign(reinterpret_cast<const char *>(data), size);
+        return _builder.Key(_text.c_str(), static_cast<rapidjson::SizeType>(size), true);
+    }
+
+    bool _typedArray(uint8_t code, const uint8_t *data, size_t size) {
+        bool valid = true;
+        bool known = TypedArrayCode::dispatch(code, [this, data, size, &valid](auto tag) {
+            using T = typename decltype(tag)::type;
+            if (size % sizeof(T) != 0) {
+                valid = false;
+                return;
+            }
+            _builder.StartArray();
+            for (size_t i = 0; i < size / sizeof(T); i++) {
+                T value;
+                std::memcpy(&value, data + i * sizeof(T), sizeof(T));
+                if constexpr (std::is_floating_point_v<T>) {
+                    _builder.Double(static_cast<double>(value));
+                } else if constexpr (std::is_signed_v<T>) {
+                    _builder.Int64(static_cast<int64_t>(value));
+                } else {
+                    _integer(static_cast<uint64_t>(value));
+                }
+            }
+            _builder.EndArray(static_cast<rapidjson::SizeType>(size / sizeof(T)));
+        });
+        if (!valid) {
+            return _fail(Status::INVALID);
+        }
+        return known || _builder.Null();
+    }
+
+    static double _halfFloat(uint16_t half) {
+        const int exponent = (half >> 10) & 0x1F;
+        const int mantissa = half & 0x3FF;
+        double value;
+        if (exponent == 0) {
+            value = std::ldexp(mantissa, -24);
+        } else if (exponent != 31) {
+            value = std::ldexp(mantissa + 1024, exponent - 25);
+        } else {
+            value = mantissa == 0 ? INFINITY : NAN;
+        }
+        return half & 0x8000 ? -value : value;
+    }
+
+    bool _cborArgument(uint8_t info, uint64_t &value) {
+        if (info < 24) {
+            value = info;
+            return true;
+        }
+        switch (info) {
+            case 24: { uint8_t v; if (!_bigEndian(v)) return false; value = v; return true; }
+            case 25: { uint16_t v; if (!_bigEndian(v)) return false; value = v; return true; }
+            case 26: { uint32_t v; if (!_bigEndian(v)) return false; value = v; return true; }
+            case 27: return _bigEndian(value);
+            default: return _fail(Status::INVALID);
+        }
+    }
+
+    /**
+     * Reads the elements of an array, or the pairs of a map, with either a count or a break byte at the end.
+     */
+    template<typename F>
+    bool _cborContainer(uint8_t info, F &&element) {
+        if (info == 31) {
+            while (true) {
+                if (_position == _end) {
+                    return _fail(Status::INCOMPLETE);
+                }
+                if (*_position == 0xFF) {
+                    _position++;
+                    return true;
+                }
+                if (!element()) {
+                    return false;
+                }
+            }
+        }
+        uint64_t count;
+        if (!_cborArgument(info, count)) {
+            return false;
+        }
+        for (uint64_t i = 0; i < count; i++) {
+            if (!element()) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool _cborItem(int depth) {
+        if (depth > MAX_DEPTH) {
+            return _fail(Status::INVALID);
+        }
+        uint8_t initial;
+        if (!_byte(initial)) {
+            return false;
+        }
+        const uint8_t major = initial >> 5;
+        const uint8_t info = initial & 0x1F;
+        uint64_t argument = 0;
+        const uint8_t *data;
+        switch (major) {
+            case 0:
+                return _cborArgument(info, argument) && _integer(argument);
+            case 1:
+                if (!_cborArgument(info, argument)) {
+                    return false;
+                }
+                if (argument > static_cast<uint64_t>(INT64_MAX)) {
+                    return _builder.Double(-1.0 - static_cast<double>(argument));
+                }
+                return _builder.Int64(-1 - static_cast<int64_t>(argument));
+            case 2:
+                return _cborArgument(info, argument) && _take(argument, data) &&
+                       _typedArray(TypedArrayCode::UINT8, data, argument);
+            case 3:
+                return _cborArgument(info, argument) && _take(argument, data) && _string(data, argument);
+            case 4:
+                _builder.StartArray();
+                return _cborContainer(info, [this, depth] { return _cborItem(depth + 1); }) && _builder.EndArray(0);
+            case 5:
+                _builder.StartObject();
+                return _cborContainer(info, [this, depth] {
+                    uint8_t key_initial;
+                    uint64_t size;
+                    const uint8_t *key;
+                    if (!_byte(key_initial)) {
+                        return false;
+                    }
+                    if (key_initial >> 5 != 3) {
+                        return _fail(Status::INVALID);
+                    }
+                    return _cborArgument(key_initial & 0x1F, size) && _take(size, key) && _key(key, size) &&
+                           _cborItem(depth + 1);
+                }) && _builder.EndObject(0);
+            case 6: {
+                if (!_cborArgument(info, argument)) {
+                    return false;
+                }
+                if (argument < 64 || argument >= 96) {
+                    // other tags do not change how their content is read
+                    return _cborItem(depth);
+                }
+                uint8_t content;
+                uint64_t size;
+                if (!_byte(content)) {
+                    return false;
+                }
+                if (content >> 5 != 2) {
+                    return _fail(Status::INVALID);
+                }
+                return _cborArgument(content & 0x1F, size) && _take(size, data) &&
+                       _typedArray(static_cast<uint8_t>(argument - 64), data, size);
+            }
+            default:
+                switch (info) {
+                    case 20:
+                    case 21:
+                        return _builder.Bool(info == 21);
+                    case 22:
+                    case 23:
+                        return _builder.Null();
+                    case 25: {
+                        uint16_t half;
+                        return _bigEndian(half) && _builder.Double(_halfFloat(half));
+                    }
+                    case 26: {
+                        float value;
+                        return _bigEndian(value) && _builder.Double(value);
+                    }
+                    case 27: {
+                        double value;
+                        return _bigEndian(value) && _builder.Double(value);
+                    }
+                    default:
+                        return _fail(Status::INVALID);
+                }
+        }
+    }
+
+    template<typename T>
+    bool _msgPackSize(uint64_t &size) {
+        T value;
+        if (!_bigEndian(value)) {
+            return false;
+        }
+        size = value;
+        return true;
+    }
+
+    bool _msgPackMap(uint64_t count, int depth) {
+        _builder.StartObject();
+        for (uint64_t i = 0; i < count; i++) {
+            uint8_t initial;
+            uint64_t size;
+            const uint8_t *key;
+            if (!_byte(initial)) {
+                return false;
+            }
+            if (initial >= 0xA0 && initial <= 0xBF) {
+                size = initial & 0x1F;
+            } else if (initial == 0xD9) {
+                if (!_msgPackSize<uint8_t>(size)) return false;
+            } else if (initial == 0xDA) {
+                if (!_msgPackSize<uint16_t>(size)) return false;
+            } else if (initial == 0xDB) {
+                if (!_msgPackSize<uint32_t>(size)) return false;
+            } else {
+                return _fail(Status::INVALID);
+            }
+            if (!_take(size, key) || !_key(key, size) || !_msgPackItem(depth + 1)) {
+                return false;
+            }
+        }
+        return _builder.EndObject(0);
+    }
+
+    bool _msgPackArray(uint64_t count, int depth) {
+        _builder.StartArray();
+        for (uint64_t i = 0; i < count; i++) {
+            if (!_msgPackItem(depth + 1)) {
+                return false;
+            }
+        }
+        return _builder.EndArray(0);
+    }
+
+    bool _msgPackExtension(uint64_t size) {
+        uint8_t type;
+        const uint8_t *data;
+        return _byte(type) && _take(size, data) && _typedArray(type, data, size);
+    }
+
+    bool _msgPackItem(int depth) {
+        if (depth > MAX_DEPTH) {
+            return _fail(Status::INVALID);
+        }
+        uint8_t initial;
+        if (!_byte(initial)) {
+            return false;
+        }
+        if (initial <= 0x7F) {
+            return _builder.Int64(initial);
+        } else if (initial <= 0x8F) {
+            return _msgPackMap(initial & 0x0F, depth);
+        } else if (initial <= 0x9F) {
+            return _msgPackArray(initial & 0x0F, depth);
+        } else if (initial <= 0xBF) {
+            const uint8_t *data;
+            return _take(initial & 0x1F, data) && _string(data, initial & 0x1F);
+        } else if (initial >= 0xE0) {
+            return _builder.Int64(static_cast<int8_t>(initial));
+        }
+
+        uint64_t size;
+        const uint8_t *data;
+        switch (initial) {
+            case 0xC0: return _builder.Null();
+            case 0xC2: return _builder.Bool(false);
+            case 0xC3: return _builder.Bool(true);
+            case 0xC4: return _msgPackSize<uint8_t>(size) && _take(size, data) && _typedArray(TypedArrayCode::UINT8, data, size);
+            case 0xC5: return _msgPackSize<uint16_t>(size) && _take(size, data) && _typedArray(TypedArrayCode::UINT8, data, size);
+            case 0xC6: return _msgPackSize<uint32_t>(size) && _take(size, data) && _typedArray(TypedArrayCode::UINT8, data, size);
+            case 0xC7: return _msgPackSize<uint8_t>(size) && _msgPackExtension(size);
+            case 0xC8: return _msgPackSize<uint16_t>(size) && _msgPackExtension(size);
+            case 0xC9: return _msgPackSize<uint32_t>(size) && _msgPackExtension(size);
+            case 0xCA: { float v; return _bigEndian(v) && _builder.Double(v); }
+            case 0xCB: { double v; return _bigEndian(v) && _builder.Double(v); }
+            case 0xCC: { uint8_t v; return _bigEndian(v) && _integer(v); }
+            case 0xCD: { uint16_t v; return _bigEndian(v) && _integer(v); }
+            case 0xCE: { uint32_t v; return _bigEndian(v) && _integer(v); }
+            case 0xCF: { uint64_t v; return _bigEndian(v) && _integer(v); }
+            case 0xD0: { int8_t v; return _bigEndian(v) && _builder.Int64(v); }
+            case 0xD1: { int16_t v; return _bigEndian(v) && _builder.Int64(v); }
+            case 0xD2: { int32_t v; return _bigEndian(v) && _builder.Int64(v); }
+            case 0xD3: { int64_t v; return _bigEndian(v) && _builder.Int64(v); }
+            case 0xD4: return _msgPackExtension(1);
+            case 0xD5: return _msgPackExtension(2);
+            case 0xD6: return _msgPackExtension(4);
+            case 0xD7: return _msgPackExtension(8);
+            case 0xD8: return _msgPackExtension(16);
+            case 0xD9: return _msgPackSize<uint8_t>(size) && _take(size, data) && _string(data, size);
+            case 0xDA: return _msgPackSize<uint16_t>(size) && _take(size, data) && _string(data, size);
+            case 0xDB: return _msgPackSize<uint32_t>(size) && _take(size, data) && _string(data, size);
+            case 0xDC: return _msgPackSize<uint16_t>(size) && _msgPackArray(size, depth);
+            case 0xDD: return _msgPackSize<uint32_t>(size) && _msgPackArray(size, depth);
+            case 0xDE: return _msgPackSize<uint16_t>(size) && _msgPackMap(size, depth);
+            case 0xDF: return _msgPackSize<uint32_t>(size) && _msgPackMap(size, depth);
+            default: return _fail(Status::INVALID);
+        }
+    }
+
+public:
+    BinaryRecordReader(InputFormat format, MessageBuilder &builder) : _format(format), _builder(builder) {}
+
+    /**
+     * Reads the record at position, and advances position behind it if it is complete.
+     * An incomplete record has not been passed on, and can be read again once more input arrived.
+     */
+    Status read(const uint8_t *&position, const uint8_t *end) {
+        _position = position;
+        _end = end;
+        _status = Status::COMPLETE;
+        _builder.reset();
+        const bool complete = _format == InputFormat::CBOR ? _cborItem(0) : _msgPackItem(0);
+        if (complete) {
+            position = _position;
+        }
+        return _status;
+    }
+};
+
+/**
+ * Parses consecutive binary records from memory.
+ * @return kParseErrorDocumentEmpty once all records are parsed, or kParseErrorValueInvalid at a malformed record
+ */
+inline rapidjson::ParseErrorCode parseBinaryRecords(InputFormat format, const uint8_t *begin, const uint8_t *end,
+                                                    MessageBuilder &builder, const std::atomic_bool &interrupted) {
+    BinaryRecordReader reader{format, builder};
+    while (begin < end && !interrupted.load()) {
+        if (reader.read(begin, end) != BinaryRecordReader::Status::COMPLETE) {
+            return rapidjson::kParseErrorValueInvalid;
+        }
+    }
+    return interrupted.load() ? rapidjson::kParseErrorTermination : rapidjson::kParseErrorDocumentEmpty;
+}
+
+/**
+ * Parses consecutive binary records from a descriptor that is read in blocks. A record that is split over
+ * blocks is read again once the rest arrived.
+ * @return kParseErrorDocumentEmpty at the end of the input, or the error that stopped parsing
+ */
+inline rapidjson::ParseErrorCode parseBinaryRecords(InputFormat format, int fd, MessageBuilder &builder,
+                                                    const std::atomic_bool &interrupted,
+                                                    size_t block_size = 1024 * 1024) {
+    BinaryRecordReader reader{format, builder};
+    std::vector<uint8_t> buffer(block_size);
+    size_t begin = 0;
+    size_t end = 0;
+    bool eof = false;
+
+    while (!interrupted.load()) {
+        const uint8_t *position = buffer.data() + begin;
+        auto status = begin < end ? reader.read(position, buffer.data() + end) : BinaryRecordReader::Status::INCOMPLETE;
+        if (status == BinaryRecordReader::Status::COMPLETE) {
+            begin = static_cast<size_t>(position - buffer.data());
+            continue;
+        } else if (status == BinaryRecordReader::Status::INVALID || (eof && begin < end)) {
+            return rapidjson::kParseErrorValueInvalid;
+        } else if (eof) {
+            return rapidjson::kParseErrorDocumentEmpty;
+        }
+
+        // keep the incomplete record, and read more behind it
+        std::memmove(buffer.data(), buffer.data() + begin, end - begin);
+        end -= begin;
+        begin = 0;
+        if (end == buffer.size()) {
+            buffer.resize(buffer.size() * 2);
+        }
+        ssize_t n = ::read(fd, buffer.data() + end, buffer.size() - end);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (!interrupted.load()) {
+                std::cerr << "Error reading input: " << std::strerror(errno) << std::endl;
+            }
+            return rapidjson::kParseErrorTermination;
+        }
+        end += static_cast<size_t>(n);
+        eof = n == 0;
+    }
+    return rapidjson::kParseErrorTermination;
+}
+
+#endif //MAVTOOLS_BINARYRECORDPARSER_H
@@ -0,0 +1,283 @@
+/****************************************************************************
+ *
+ * Copyright (c) 2024, libmav development team
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name libmav nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+#ifndef MAVTOOLS_PARALLELENCODER_H
+#define MAVTOOLS_PARALLELENCODER_H
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+#include "../common/Tlog.h"
+#include "RecordParser.h"
+
+/**
+ * A piece of newline-delimited JSON input that only contains whole lines. It is parsed in situ,
+ * either in its own storage or in a copy-on-write mapping.
+ */
+struct InputBlock {
+    std::vector<char> storage;
+    char *begin = nullptr;
+    char *end = nullptr;
+};
+
+/**
+ * Cuts an in-memory input into blocks of about block_size bytes, at the next newline.
+ */
+class MappedBlocks {
+private:
+    char *_position;
+    char *_end;
+    const size_t _block_size;
+
+public:
+    MappedBlocks(char *begin, char *end, size_t block_size) : _position(begin), _end(end), _block_size(block_size) {}
+
+    bool next(InputBlock &block) {
+        if (_position >= _end) {
+            return false;
+        }
+        char *cut = _position + std::min(_block_size, static_cast<size_t>(_end - _position));
+        auto newline = static_cast<char *>(std::memchr(cut, '\n', _end - cut));
+        cut = newline ? newline + 1 : _end;
+        block.begin = _position;
+        block.end = cut;
+        _position = cut;
+        return true;
+    }
+};
+
+/**
+ * Reads a descriptor in blocks of at least block_size bytes, and carries the incomplete last line over to
+ * the next block.
+ */
+class StreamBlocks {
+private:
+    const int _fd;
+    const size_t _block_size;
+    const std::atomic_bool &_interrupted;
+    std::vector<char> _carry;
+    bool _eof = false;
+
+public:
+    StreamBlocks(int fd, size_t block_size, const std::atomic_bool &interrupted) :
+            _fd(fd), _block_size(block_size), _interrupted(interrupted) {}
+
+    bool next(InputBlock &block) {
+        if (_eof) {
+            return false;
+        }
+        std::vector<char> &buffer = block.storage;
+        buffer.resize(std::max(_block_size, _carry.size() * 2));
+        std::copy(_carry.begin(), _carry.end(), buffer.begin());
+        size_t size = _carry.size();
+        size_t cut = 0;
+        while (!_eof) {
+            if (size == buffer.size()) {
+                // a single line longer than the block
+                buffer.resize(buffer.size() * 2);
+            }
+            ssize_t n = ::read(_fd, buffer.data() + size, buffer.size() - size);
+            if (n < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                if (!_interrupted.load()) {
+                    std::cerr << "Error reading input: " << std::strerror(errno) << std::endl;
+                }
+                n = 0;
+            }
+            _eof = n == 0;
+            size += static_cast<size_t>(n);
+            if (_eof) {
+                cut = size;
+            } else if (size >= _block_size) {
+                auto newline = static_cast<const char *>(::memrchr(buffer.data(), '\n', size));
+                cut = newline ? static_cast<size_t>(newline - buffer.data()) + 1 : 0;
+                if (cut > 0) {
+                    break;
+                }
+            }
+        }
+        _carry.assign(buffer.begin() + cut, buffer.begin() + size);
+        block.begin = buffer.data();
+        block.end = buffer.data() + cut;
+        return cut > 0;
+    }
+};
+
+/**
+ * Encodes newline-delimited JSON records on a pool of worker threads, and writes the frames in the
+ * original record order. Every record carries its own sequence number, so the output does not depend
+ * on which worker encoded it.
+ */
+class ParallelEncoder {
+private:
+    // maximum number of blocks in flight, per thread
+    static constexpr size_t WINDOW_PER_THREAD = 2;
+
+    struct EncodedBlock {
+        std::string frames;
+        rapidjson::ParseErrorCode error;
+    };
+
+    const mav::MessageSet &_message_set;
+    const int _threads;
+    // write every frame as a tlog record, preceded by the timestamp of its JSON record
+    const bool _tlog;
+
+public:
+    static constexpr size_t BLOCK_SIZE = 4 * 1024 * 1024; // 4 MiB
+
+    ParallelEncoder(const mav::MessageSet &message_set, int threads, bool tlog = false) :
+            _message_set(message_set), _threads(std::max(threads, 1)), _tlog(tlog) {}
+
+    /**
+     * @param blocks source of input blocks, MappedBlocks or StreamBlocks
+     * @param output called with the frames of every block, in order
+     * @return kParseErrorDocumentEmpty once all records are encoded, or the error that stopped encoding
+     */
+    template<typename Blocks>
+    rapidjson::ParseErrorCode encode(Blocks &blocks, const std::function<void(std::string_view)> &output,
+                                     const std::atomic_bool &interrupted) {
+        const size_t window = _threads * WINDOW_PER_THREAD;
+
+        std::deque<std::pair<size_t, InputBlock>> queue;
+        std::map<size_t, EncodedBlock> encoded;
+        bool finished = false;
+        std::mutex mutex;
+        std::condition_variable cv;
+
+        auto worker = [&] {
+            std::string *frames = nullptr;
+            MessageBuilder builder{_message_set, [this, &frames](const uint8_t *data, size_t size, uint64_t timestamp_us) {
+                if (_tlog) {
+                    auto timestamp = encodeTlogTimestamp(timestamp_us);
+                    frames->append(timestamp.data(), timestamp.size());
+                }
+                frames->append(reinterpret_cast<const char *>(data), size);
+            }};
+            std::unique_lock<std::mutex> lock(mutex);
+            while (true) {
+                cv.wait(lock, [&] {
+                    return finished || !queue.empty();
+                });
+                if (finished) {
+                    return;
+                }
+                auto [index, block] = std::move(queue.front());
+                queue.pop_front();
+                lock.unlock();
+                EncodedBlock result;
+                frames = &result.frames;
+                result.error = parseRecords(block.begin, block.end, builder, interrupted);
+                lock.lock();
+                encoded[index] = std::move(result);
+                cv.notify_all();
+            }
+        };
+
+        std::vector<std::thread> workers;
+        for (int i = 0; i < _threads; i++) {
+            workers.emplace_back(worker);
+        }
+
+        auto error = rapidjson::kParseErrorDocumentEmpty;
+        size_t submitted = 0;
+        size_t written = 0;
+        bool input_done = false;
+        while (!interrupted.load()) {
+            if (!input_done && submitted < written + window) {
+                InputBlock block;
+                if (blocks.next(block)) {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    queue.emplace_back(submitted++, std::move(block));
+                    cv.notify_all();
+                } else {
+                    input_done = true;
+                }
+                continue;
+            }
+            if (written == submitted) {
+                break;
+            }
+
+            EncodedBlock result;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                // wake up periodically to check for interrupts
+                while (encoded.count(written) == 0 && !interrupted.load()) {
+                    cv.wait_for(lock, std::chrono::milliseconds(100));
+                }
+                auto it = encoded.find(written);
+                if (it == encoded.end()) {
+                    break;
+                }
+                result = std::move(it->second);
+                encoded.erase(it);
+            }
+            output(result.frames);
+            written++;
+            if (result.error != rapidjson::kParseErrorDocumentEmpty) {
+                error = result.error;
+                break;
+            }
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            finished = true;
+            cv.notify_all();
+        }
+        for (auto &thread : workers) {
+            thread.join();
+        }
+        return error;
+    }
+};
+
+#endif //MAVTOOLS_PARALLELENCODER_H
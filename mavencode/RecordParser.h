@@ -0,0 +1,512 @@
+/****************************************************************************
+ *
+ * Copyright (c) 2024, libmav development team
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name libmav nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+#ifndef MAVTOOLS_RECORDPARSER_H
+#define MAVTOOLS_RECORDPARSER_H
+
+#include <atomic>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include <unistd.h>
+
+#include "mav/MessageSet.h"
+#include "rapidjson/reader.h"
+
+/**
+ * rapidjson input stream over [begin, end) that does not need a terminating zero.
+ * Also serves as its own output stream, so it can be parsed in situ.
+ */
+class BoundedStream {
+private:
+    char *_head;
+    char *_src;
+    char *_end;
+    char *_dst = nullptr;
+
+public:
+    using Ch = char;
+
+    BoundedStream(char *begin, char *end) : _head(begin), _src(begin), _end(end) {}
+
+    [[nodiscard]] Ch Peek() const {
+        return _src < _end ? *_src : '\0';
+    }
+
+    Ch Take() {
+        return _src < _end ? *_src++ : '\0';
+    }
+
+    [[nodiscard]] size_t Tell() const {
+        return static_cast<size_t>(_src - _head);
+    }
+
+    Ch *PutBegin() {
+        return _dst = _src;
+    }
+
+    void Put(Ch c) {
+        *_dst++ = c;
+    }
+
+    size_t PutEnd(Ch *begin) {
+        return static_cast<size_t>(_dst - begin);
+    }
+
+    void Flush() {}
+};
+
+/**
+ * SAX handler that writes the values of one JSON record after the other straight into a mav::Message,
+ * and hands each finalized frame to a sink. Expects "id" before "fields", which is how mavdecode writes records.
+ * The sink also gets the "timestamp_us" of the record, or 0 if it has none.
+ * Messages are copied from a pristine template per message id, which also caches how field names resolve.
+ */
+class MessageBuilder {
+public:
+    using Sink = std::function<void(const uint8_t *data, size_t size, uint64_t timestamp_us)>;
+
+private:
+    enum class RecordKey {
+        OTHER,
+        ID,
+        SYSTEM_ID,
+        COMPONENT_ID,
+        SEQ,
+        TIMESTAMP,
+        FIELDS
+    };
+
+    struct FieldSlot {
+        bool known;
+        int count;          // number of elements, 1 for scalars
+    };
+
+    struct MessageTemplate {
+        mav::Message message;
+        std::unordered_map<std::string, FieldSlot> fields;
+    };
+
+    const mav::MessageSet &_message_set;
+    Sink _sink;
+    // null for ids that are not in the message set
+    std::unordered_map<int, std::unique_ptr<MessageTemplate>> _templates;
+
+    int _depth = 0;
+    // depth of a value that is skipped including everything inside it, 0 if none
+    int _ignore_depth = 0;
+    RecordKey _key = RecordKey::OTHER;
+
+    bool _has_id = false;
+    int _system_id = -1;
+    int _component_id = -1;
+    int _seq = 0;
+    uint64_t _timestamp_us = 0;
+    MessageTemplate *_template = nullptr;
+    std::optional<mav::Message> _message;
+
+    // reused, so field names and string values do not allocate once warmed up
+    std::string _field;
+    std::string _string_value;
+    const FieldSlot *_slot = nullptr;
+    int _index = 0;
+
+    void beginRecord() {
+        _key = RecordKey::OTHER;
+        _has_id = false;
+        _system_id = -1;
+        _component_id = -1;
+        _seq = 0;
+        _timestamp_us = 0;
+        _template = nullptr;
+        _slot = nullptr;
+        _message.reset();
+    }
+
+    void endRecord() {
+        if (!_has_id) {
+            std::cerr << "No name field in JSON object" << std::endl;
+            return;
+        }
+        if (!_message) {
+            // unknown id, already reported
+            return;
+        }
+        if (_system_id >= 0) {
+            _message->header().systemId() = _system_id;
+        }
+        if (_component_id >= 0) {
+            _message->header().componentId() = _component_id;
+        }
+        int len = _message->finalize(_seq, {1, 1});
+        if (len < 0) {
+            std::cerr << "Error finalizing message: " << len << std::endl;
+        } else {
+            _sink(_message->data(), static_cast<size_t>(len), _timestamp_us);
+        }
+    }
+
+    void setId(int id) {
+        _has_id = true;
+        auto it = _templates.find(id);
+        if (it == _templates.end()) {
+            std::unique_ptr<MessageTemplate> message_template;
+            try {
+                message_template.reset(new MessageTemplate{_message_set.create(id), {}});
+            } catch (std::out_of_range &e) {
+                // remember unknown ids as well
+            }
+            it = _templates.emplace(id, std::move(message_template)).first;
+        }
+        _template = it->second.get();
+        if (_template) {
+            _message.emplace(_template->message);
+        } else {
+            std::cerr << "Unknown message id: " << id << std::endl;
+        }
+    }
+
+    void resolveField() {
+        auto it = _template->fields.find(_field);
+        if (it == _template->fields.end()) {
+            FieldSlot slot{false, 0};
+            if (_template->message.type().containsField(_field)) {
+                slot = {true, _template->message.type().fieldForName(_field).type.size};
+            }
+            it = _template->fields.emplace(_field, slot).first;
+        }
+        _slot = &it->second;
+    }
+
+    void setHeader(int64_t value) {
+        switch (_key) {
+            case RecordKey::ID:
+                setId(static_cast<int>(value));
+                break;
+            case RecordKey::SYSTEM_ID:
+                _system_id = static_cast<int>(value);
+                break;
+            case RecordKey::COMPONENT_ID:
+                _component_id = static_cast<int>(value);
+                break;
+            case RecordKey::SEQ:
+                _seq = static_cast<int>(value);
+                break;
+            case RecordKey::TIMESTAMP:
+                _timestamp_us = static_cast<uint64_t>(value);
+                break;
+            default:
+                break;
+        }
+    }
+
+    void fieldError(const char *what) {
+        std::cerr << "Error setting field " << _field << " on message " << _message->name() << ": " << what << std::endl;
+    }
+
+    template<typename T>
+    void setField(T value) {
+        if (!_message || !_slot->known) {
+            return;
+        }
+        if (_index >= _slot->count) {
+            fieldError("Too many elements");
+            return;
+        }
+        try {
+            _message->set(_field, value, _index);
+        } catch (std::exception &e) {
+            fieldError(e.what());
+        }
+    }
+
+    /**
+     * Routes a scalar value to the header or to the current field, depending on where it is.
+     */
+    template<typename T>
+    bool value(T value) {
+        if (_ignore_depth) {
+            return true;
+        }
+        if (_depth == 1) {
+            if constexpr (std::is_integral_v<T>) {
+                setHeader(static_cast<int64_t>(value));
+            }
+        } else if (_depth >= 2) {
+            setField(value);
+            _index++;
+        }
+        return true;
+    }
+
+    bool unsupportedValue() {
+        if (!_ignore_depth && _depth >= 2 && _message && _slot->known) {
+            fieldError("Unknown type");
+        }
+        return true;
+    }
+
+    bool enter(bool is_object) {
+        _depth++;
+        if (_ignore_depth) {
+            return true;
+        }
+        if (_depth == 1 && is_object) {
+            beginRecord();
+        } else if (_depth == 2 && is_object && _key == RecordKey::FIELDS) {
+            if (!_has_id) {
+                std::cerr << "Fields before id in JSON object, skipping them" << std::endl;
+                _ignore_depth = _depth;
+            }
+        } else if (_depth == 3 && !is_object) {
+            _index = 0;
+        } else {
+            if (_depth > 2) {
+                unsupportedValue();
+            }
+            _ignore_depth = _depth;
+        }
+        return true;
+    }
+
+    bool leave() {
+        if (_ignore_depth == _depth) {
+            _ignore_depth = 0;
+        } else if (_depth == 1 && !_ignore_depth) {
+            endRecord();
+        }
+        _depth--;
+        return true;
+    }
+
+public:
+    MessageBuilder(const mav::MessageSet &message_set, Sink sink) :
+            _message_set(message_set), _sink(std::move(sink)) {}
+
+    /**
+     * Forget a partially parsed record, before parsing starts over.
+     */
+    void reset() {
+        _depth = 0;
+        _ignore_depth = 0;
+    }
+
+    bool Null() {
+        return unsupportedValue();
+    }
+
+    bool Bool(bool) {
+        return unsupportedValue();
+    }
+
+    bool Int(int i) {
+        return value(static_cast<int64_t>(i));
+    }
+
+    bool Uint(unsigned u) {
+        return value(static_cast<int64_t>(u));
+    }
+
+    bool Int64(int64_t i) {
+        return value(i);
+    }
+
+    bool Uint64(uint64_t u) {
+        return value(u);
+    }
+
+    bool Double(double d) {
+        return value(d);
+    }
+
+    bool RawNumber(const char *, rapidjson::SizeType, bool) {
+        return unsupportedValue();
+    }
+
+    bool String(const char *str, rapidjson::SizeType length, bool) {
+        if (_ignore_depth || _depth < 2) {
+            return true;
+        }
+        // mavdecode writes non-finite floats as strings
+        if (std::strcmp(str, "NaN") == 0) {
+            return value(static_cast<double>(NAN));
+        } else if (std::strcmp(str, "Infinity") == 0) {
+            return value(static_cast<double>(INFINITY));
+        } else if (std::strcmp(str, "-Infinity") == 0) {
+            return value(static_cast<double>(-INFINITY));
+        }
+        if (_depth > 2) {
+            return unsupportedValue();
+        }
+        if (_message && _slot->known) {
+            _string_value.assign(str, length);
+            try {
+                _message->set(_field, _string_value);
+            } catch (std::exception &e) {
+                fieldError(e.what());
+            }
+        }
+        return true;
+    }
+
+    bool StartObject() {
+        return enter(true);
+    }
+
+    bool Key(const char *str, rapidjson::SizeType length, bool) {
+        if (_ignore_depth) {
+            return true;
+        }
+        if (_depth == 1) {
+            std::string_view key{str, length};
+            _key = key == "id" ? RecordKey::ID :
+                   key == "system_id" ? RecordKey::SYSTEM_ID :
+                   key == "component_id" ? RecordKey::COMPONENT_ID :
+                   key == "seq" ? RecordKey::SEQ :
+                   key == "timestamp_us" ? RecordKey::TIMESTAMP :
+                   key == "fields" ? RecordKey::FIELDS : RecordKey::OTHER;
+        } else if (_depth == 2 && _message) {
+            _field.assign(str, length);
+            _index = 0;
+            resolveField();
+            if (!_slot->known) {
+                std::cerr << "Unknown field: " << _field << " on message " << _message->name() << std::endl;
+            }
+        }
+        return true;
+    }
+
+    bool EndObject(rapidjson::SizeType) {
+        return leave();
+    }
+
+    bool StartArray() {
+        return enter(false);
+    }
+
+    bool EndArray(rapidjson::SizeType) {
+        return leave();
+    }
+};
+
+/**
+ * Parses consecutive JSON records from memory in situ, the buffer is modified in place.
+ * @return kParseErrorDocumentEmpty once all records are parsed, or the error that stopped parsing
+ */
+inline rapidjson::ParseErrorCode parseRecords(char *begin, char *end, MessageBuilder &builder,
+                                              const std::atomic_bool &interrupted) {
+    rapidjson::Reader reader;
+    BoundedStream stream{begin, end};
+    while (!interrupted.load()) {
+        builder.reset();
+        reader.Parse<rapidjson::kParseInsituFlag | rapidjson::kParseStopWhenDoneFlag>(stream, builder);
+        if (reader.HasParseError()) {
+            return reader.GetParseErrorCode();
+        }
+    }
+    return rapidjson::kParseErrorDocumentEmpty;
+}
+
+/**
+ * Parses consecutive JSON records from a descriptor that is read in blocks. Each parse only sees input up to
+ * the last newline read so far, so a record that is split over blocks is parsed again once the rest arrived.
+ * @return kParseErrorDocumentEmpty at the end of the input, or the error that stopped parsing
+ */
+inline rapidjson::ParseErrorCode parseRecords(int fd, MessageBuilder &builder, const std::atomic_bool &interrupted,
+                                              size_t block_size = 1024 * 1024) {
+    rapidjson::Reader reader;
+    std::vector<char> buffer(block_size);
+    size_t begin = 0;
+    size_t end = 0;
+    size_t parsable = 0;
+    bool eof = false;
+
+    while (!interrupted.load()) {
+        if (begin < parsable) {
+            BoundedStream stream{buffer.data() + begin, buffer.data() + parsable};
+            builder.reset();
+            // the stream is not parsed in situ, so a record that turns out to be incomplete can be parsed again
+            reader.Parse<rapidjson::kParseStopWhenDoneFlag>(stream, builder);
+            if (!reader.HasParseError()) {
+                begin += stream.Tell();
+                continue;
+            }
+            bool incomplete = reader.GetErrorOffset() >= parsable - begin;
+            if (!incomplete || eof) {
+                return reader.GetParseErrorCode();
+            }
+        } else if (eof) {
+            return rapidjson::kParseErrorDocumentEmpty;
+        }
+
+        // keep the unparsed tail, and read more behind it
+        std::memmove(buffer.data(), buffer.data() + begin, end - begin);
+        end -= begin;
+        parsable -= begin;
+        begin = 0;
+        if (end == buffer.size()) {
+            buffer.resize(buffer.size() * 2);
+        }
+        ssize_t n = ::read(fd, buffer.data() + end, buffer.size() - end);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (!interrupted.load()) {
+                std::cerr << "Error reading input: " << std::strerror(errno) << std::endl;
+            }
+            return rapidjson::kParseErrorTermination;
+        }
+        end += static_cast<size_t>(n);
+        eof = n == 0;
+        if (eof) {
+            parsable = end;
+        } else {
+            auto newline = static_cast<const char *>(::memrchr(buffer.data(), '\n', end));
+            parsable = newline ? static_cast<size_t>(newline - buffer.data()) + 1 : 0;
+        }
+    }
+    return rapidjson::kParseErrorTermination;
+}
+
+#endif //MAVTOOLS_RECORDPARSER_H
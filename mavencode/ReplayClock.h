@@ -0,0 +1,101 @@
+/****************************************************************************
+ *
+ * Copyright (c) 2024, libmav development team
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name libmav nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+#ifndef MAVTOOLS_REPLAYCLOCK_H
+#define MAVTOOLS_REPLAYCLOCK_H
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <ctime>
+
+#include "../common/Histogram.h"
+
+/**
+ * Paces replayed frames by their recorded timestamps. Every deadline is absolute, relative to the first frame,
+ * so sleeping never accumulates drift, and the lateness of every frame is kept in a histogram.
+ */
+class ReplayClock {
+private:
+    static constexpr int64_t NANOSECONDS_PER_SECOND = 1000000000;
+
+    const double _speed;
+    bool _started = false;
+    uint64_t _first_timestamp_us = 0;
+    int64_t _start_ns = 0;
+    int64_t _deadline_ns = 0;
+    Histogram _errors_us;
+
+    static int64_t _now() {
+        timespec time{};
+        ::clock_gettime(CLOCK_MONOTONIC, &time);
+        return static_cast<int64_t>(time.tv_sec) * NANOSECONDS_PER_SECOND + time.tv_nsec;
+    }
+
+public:
+    explicit ReplayClock(double speed) : _speed(speed) {}
+
+    /**
+     * Sleeps until the frame recorded at timestamp_us is due. Frames that are already late, including
+     * frames with a timestamp before the first one, are due immediately. Returns early when interrupted.
+     */
+    void waitFor(uint64_t timestamp_us, const std::atomic_bool &interrupted) {
+        if (!_started) {
+            _started = true;
+            _first_timestamp_us = timestamp_us;
+            _start_ns = _now();
+        }
+        const double offset_us = timestamp_us >= _first_timestamp_us ?
+                static_cast<double>(timestamp_us - _first_timestamp_us) : 0.0;
+        _deadline_ns = _start_ns + static_cast<int64_t>(offset_us * 1000.0 / _speed);
+        timespec deadline{static_cast<time_t>(_deadline_ns / NANOSECONDS_PER_SECOND),
+                          static_cast<long>(_deadline_ns % NANOSECONDS_PER_SECOND)};
+        while (::clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, nullptr) == EINTR && !interrupted.load()) {
+        }
+    }
+
+    /**
+     * Records how late the frame that was waited for last actually went out.
+     */
+    void sent() {
+        _errors_us.add(static_cast<uint64_t>(std::max<int64_t>(_now() - _deadline_ns, 0) / 1000));
+    }
+
+    [[nodiscard]] const Histogram &errors() const {
+        return _errors_us;
+    }
+};
+
+#endif //MAVTOOLS_REPLAYCLOCK_H
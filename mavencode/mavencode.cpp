@@ -33,11 +33,20 @@
  ****************************************************************************/
 
 #include <iostream>
+#include <cerrno>
+#include <cstring>
+#include <optional>
+#include <fcntl.h>
+#include <unistd.h>
 #include "args/args.hxx"
-#include "rapidjson/document.h"
-#include "rapidjson/istreamwrapper.h"
-#include "../common/DummyInterface.h"
+#include "../common/MappedFile.h"
+#include "../common/OutputWriter.h"
 #include "../common/builtinMessageSet.h"
+#include "../common/Tlog.h"
+#include "BinaryRecordParser.h"
+#include "ParallelEncoder.h"
+#include "RecordParser.h"
+#include "ReplayClock.h"
 
 
 namespace {
@@ -52,89 +61,23 @@ namespace {
             exit(0);
         }
     }
-}
-
-using rapidjson_value_t = rapidjson::GenericValue<rapidjson::UTF8<char>>;
-
-bool isFloatingPoint(const rapidjson_value_t &value) {
-    if (value.IsDouble()) {
-        return true;
-    } else if (value.IsString()) {
-        std::string str = value.GetString();
-        if (str == "NaN" || str == "Infinity" || str == "-Infinity") {
-            return true;
-        }
-    }
-    return false;
-}
-
-bool isUnsigned(const rapidjson_value_t &value) {
-    return value.IsUint() || value.IsUint64();
-}
-
-bool isSigned(const rapidjson_value_t &value) {
-    return value.IsInt() || value.IsInt64();
-}
-
-bool isString(const rapidjson_value_t &value) {
-    return value.IsString() && !isFloatingPoint(value);
-}
-
-double parseFloating(const rapidjson_value_t &value) {
-    if (value.IsDouble()) {
-        return value.GetDouble();
-    } else if (value.IsString()) {
-        std::string str = value.GetString();
-        if (str == "NaN") {
-            return NAN;
-        } else if (str == "Infinity") {
-            return INFINITY;
-        } else if (str == "-Infinity") {
-            return -INFINITY;
-        }
-    }
-    return NAN;
-}
 
-mav::NativeVariantType fromGeneric(const rapidjson_value_t &generic) {
-    if (isFloatingPoint(generic)) {
-        return parseFloating(generic);
-    } else if (isSigned(generic)) {
-        return generic.GetInt64();
-    } else if (isUnsigned(generic)) {
-        return generic.GetUint64();
-    } else if (isString(generic)) {
-        return std::string{generic.GetString()};
-    } else if (generic.IsArray()) {
-        if (generic.Size() == 0) {
-            return std::vector<int64_t>{};
-        }
-        auto array = generic.GetArray();
-        if (isFloatingPoint(*array.begin())) {
-            std::vector<double> r;
-            for (auto &value : array) {
-                r.emplace_back(parseFloating(value));
-            }
-            return r;
-        } else if (isSigned(*array.begin())) {
-            std::vector<int64_t> r;
-            for (auto &value : array) {
-                r.emplace_back(value.GetInt64());
-            }
-            return r;
-        } else if (isUnsigned(*array.begin())) {
-            std::vector<uint64_t> r;
-            for (auto &value : array) {
-                r.emplace_back(value.GetUint64());
+    /**
+     * Writes synchronously, for frames that have to leave at a precise time.
+     */
+    void writeAll(int fd, std::string_view data) {
+        while (!data.empty()) {
+            ssize_t res = ::write(fd, data.data(), data.size());
+            if (res < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                std::cerr << "Error writing output: " << std::strerror(errno) << std::endl;
+                return;
             }
-            return r;
-        } else {
-            throw std::runtime_error("Unknown type");
+            data.remove_prefix(static_cast<size_t>(res));
         }
-    } else {
-        throw std::runtime_error("Unknown type");
     }
-    return 0;
 }
 
 
@@ -143,7 +86,14 @@ int main(int argc, char *argv[]) {
     args::HelpFlag help(parser, "help", "Display this help menu", {'h', "help"});
     args::ValueFlag<std::string> xml_file(parser, "xml_file", "XML file containing the message set", {'x', "xml"});
     args::ValueFlag<std::string> output_file(parser, "output_file", "Output file for encoded messages. Writes to stdout when set to - or not set.", {'o', "output"});
-    args::Positional<std::string> input_file(parser, "input_file", "JSON file containing mavlink messages to encode. Reads stdin when set to - or not set.", args::Options::Single);
+    args::ValueFlag<std::string> flush_policy(parser, "policy", "When to write encoded output: message, interval or full. Defaults to full for files and interval otherwise.", {"flush"});
+    args::ValueFlag<int> flush_interval(parser, "ms", "Flush interval in milliseconds for the interval flush policy", {"flush-interval"}, 50);
+    args::ValueFlag<int> threads(parser, "threads", "Number of threads encoding newline-delimited JSON in parallel. 0 uses all cores.", {'j', "threads"}, 1);
+    args::ValueFlag<std::string> format(parser, "format", "Input format: json, cbor or msgpack, as written by mavdecode", {"format"}, "json");
+    args::Flag tlog(parser, "tlog", "Write a tlog capture, with the timestamp_us of every record in front of its frame", {"tlog"});
+    args::Flag replay(parser, "replay", "Send every frame at the time given by the timestamp_us of its record, relative to the first record", {"replay"});
+    args::ValueFlag<double> speed(parser, "factor", "Speed multiplier for --replay", {"speed"}, 1.0);
+    args::Positional<std::string> input_file(parser, "input_file", "File containing mavlink messages to encode. Reads stdin when set to - or not set.", args::Options::Single);
 
     try {
         parser.ParseCLI(argc, argv);
@@ -166,116 +116,164 @@ int main(int argc, char *argv[]) {
         loadBuiltinMessageSet(message_set);
     }
 
-    std::shared_ptr<std::istream> input_stream;
-    if (!input_file || args::get(input_file) == "-") {
-        std::cerr << "Reading from stdin" << std::endl;
-        input_stream = std::shared_ptr<std::istream>(&std::cin, [](std::istream *) {});
-    } else {
-        std::cerr << "Reading from file: " << args::get(input_file) << std::endl;
-        input_stream = std::make_shared<std::ifstream>(args::get(input_file), std::ios::binary);
+    std::optional<OutputWriter::FlushPolicy> policy;
+    if (flush_policy) {
+        policy = OutputWriter::parseFlushPolicy(args::get(flush_policy));
+        if (!policy) {
+            std::cerr << "Unknown flush policy: " << args::get(flush_policy) << std::endl;
+            return 1;
+        }
+    }
+    const std::chrono::milliseconds interval{args::get(flush_interval)};
+
+    auto input_format = parseInputFormat(args::get(format));
+    if (!input_format) {
+        std::cerr << "Unknown input format: " << args::get(format) << std::endl;
+        return 1;
     }
+    const bool binary = *input_format != InputFormat::JSON;
 
-    std::shared_ptr<std::ostream> output_stream;
-    if (!output_file) {
+    if (args::get(speed) <= 0) {
+        std::cerr << "Replay speed must be positive" << std::endl;
+        return 1;
+    }
+
+    int output_fd = STDOUT_FILENO;
+    if (!output_file || args::get(output_file) == "-") {
         std::cerr << "Writing to stdout" << std::endl;
-        output_stream = std::shared_ptr<std::ostream>(&std::cout, [](std::ostream *) {});
     } else {
         std::cerr << "Writing to file: " << args::get(output_file) << std::endl;
-        output_stream = std::make_shared<std::ofstream>(args::get(output_file), std::ios::binary);
+        output_fd = ::open(args::get(output_file).c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (output_fd < 0) {
+            std::cerr << "Could not open " << args::get(output_file) << std::endl;
+            return 1;
+        }
     }
 
     std::atomic_bool interrupted{false};
     int retval = 0;
+    bool from_stdin = !input_file || args::get(input_file) == "-";
+    bool mapped = !from_stdin && MappedFile::isRegularFile(args::get(input_file));
 
     auto signal_handler = [&](int signal) {
         interrupted.store(true);
         retval = signal;
-        // set the eof bit on cin to stop the input loop
-        if (input_stream.get() == &std::cin) {
-            std::cin.setstate(std::ios::eofbit);
+        // close stdin to stop a blocking read
+        if (from_stdin) {
             std::fclose(stdin);
-        } else {
-            // we are using a file
-            input_stream->setstate(std::ios::eofbit);
-            std::ifstream* file = dynamic_cast<std::ifstream*>(input_stream.get());
-            if (file) {
-                file->close();
-            }
         }
     };
     signalHandlerImpl = signal_handler;
 
-    rapidjson::Document document;
-    rapidjson::IStreamWrapper isw{*input_stream};
-
-    while (!document.HasParseError()) {
-        document.ParseStream<rapidjson::kParseStopWhenDoneFlag>(isw);
-
-        if (document.HasMember("id")) {
-            int id = document["id"].GetInt();
-            try {
-                auto message = message_set.create(id);
-                if (document.HasMember("system_id")) {
-                    message.header().systemId() = document["system_id"].GetInt();
-                }
-                if (document.HasMember("component_id")) {
-                    message.header().componentId() = document["component_id"].GetInt();
-                }
-
-                int seq = 0;
-                if (document.HasMember("seq")) {
-                    seq = document["seq"].GetInt();
-                }
+    int thread_count = args::get(threads) > 0 ?
+            args::get(threads) : static_cast<int>(std::thread::hardware_concurrency());
+    if (replay && thread_count > 1) {
+        std::cerr << "Replaying on a single thread" << std::endl;
+        thread_count = 1;
+    }
+    if (binary && thread_count > 1) {
+        // binary records have no delimiter to cut the input at
+        std::cerr << "Binary input is encoded on a single thread" << std::endl;
+        thread_count = 1;
+    }
+    // frames are collected into large blocks, and written on a separate thread
+    OutputWriter output{output_fd, policy.value_or(mapped ? OutputWriter::FlushPolicy::FULL : OutputWriter::FlushPolicy::INTERVAL), interval};
+    std::optional<ReplayClock> replay_clock;
+    if (replay) {
+        replay_clock.emplace(args::get(speed));
+    }
+    std::string tlog_record;
+    MessageBuilder builder{message_set, [&](const uint8_t *data, size_t size, uint64_t timestamp_us) {
+        std::string_view frame{reinterpret_cast<const char *>(data), size};
+        if (tlog) {
+            auto timestamp = encodeTlogTimestamp(timestamp_us);
+            tlog_record.assign(timestamp.data(), timestamp.size()).append(frame);
+            frame = tlog_record;
+        }
+        if (!replay_clock) {
+            output.write(frame);
+            return;
+        }
+        // bypass the writer thread, so the frame leaves as close to its deadline as possible
+        replay_clock->waitFor(timestamp_us, interrupted);
+        if (!interrupted.load()) {
+            writeAll(output_fd, frame);
+            replay_clock->sent();
+        }
+    }};
+    ParallelEncoder encoder{message_set, thread_count, static_cast<bool>(tlog)};
+    auto write_frames = [&output](std::string_view frames) {
+        output.write(frames);
+    };
+    if (thread_count > 1) {
+        std::cerr << "Encoding with " << thread_count << " threads" << std::endl;
+    }
 
-                if (document.HasMember("fields")) {
-                    for (auto &field : document["fields"].GetObject()) {
-                        std::string name = field.name.GetString();
-                        if (message.type().containsField(name)) {
-                            try {
-                                message.setFromNativeTypeVariant(name, fromGeneric(field.value));
-                            } catch (std::runtime_error &e) {
-                                std::cerr << "Error setting field " << name << " on message " << message.name() << ": " << e.what() << std::endl;
-                            }
-                        } else {
-                            std::cerr << "Unknown field: " << name << " on message " << message.name() << std::endl;
-                        }
-                    }
-                }
-                int len = message.finalize(seq, {1, 1});
-                if (len < 0) {
-                    std::cerr << "Error finalizing message: " << len << std::endl;
-                } else {
-                    output_stream->write(reinterpret_cast<const char *>(message.data()), len);
-                }
-            } catch (std::out_of_range &e) {
-                std::cerr << "Unknown message id: " << id << std::endl;
+    rapidjson::ParseErrorCode error;
+    std::optional<MappedFile> mapped_file;
+    if (mapped) {
+        std::cerr << "Reading from file: " << args::get(input_file) << std::endl;
+        try {
+            // text is parsed in situ, in a private copy-on-write mapping
+            mapped_file.emplace(args::get(input_file), !binary);
+        } catch (std::runtime_error &e) {
+            std::cerr << e.what() << std::endl;
+            return 1;
+        }
+    }
+    if (mapped && binary) {
+        error = parseBinaryRecords(*input_format, mapped_file->data(), mapped_file->data() + mapped_file->size(),
+                                   builder, interrupted);
+    } else if (mapped) {
+        auto begin = reinterpret_cast<char *>(mapped_file->mutableData());
+        if (thread_count > 1) {
+            MappedBlocks blocks{begin, begin + mapped_file->size(), ParallelEncoder::BLOCK_SIZE};
+            error = encoder.encode(blocks, write_frames, interrupted);
+        } else {
+            error = parseRecords(begin, begin + mapped_file->size(), builder, interrupted);
+        }
+    } else {
+        int fd = STDIN_FILENO;
+        if (from_stdin) {
+            std::cerr << "Reading from stdin" << std::endl;
+        } else {
+            std::cerr << "Reading from file: " << args::get(input_file) << std::endl;
+            fd = ::open(args::get(input_file).c_str(), O_RDONLY);
+            if (fd < 0) {
+                std::cerr << "Could not open " << args::get(input_file) << std::endl;
+                return 1;
             }
+        }
+        if (binary) {
+            error = parseBinaryRecords(*input_format, fd, builder, interrupted);
+        } else if (thread_count > 1) {
+            StreamBlocks blocks{fd, ParallelEncoder::BLOCK_SIZE, interrupted};
+            error = encoder.encode(blocks, write_frames, interrupted);
         } else {
-            std::cerr << "No name field in JSON object" << std::endl;
+            error = parseRecords(fd, builder, interrupted);
+        }
+        if (!from_stdin) {
+            ::close(fd);
         }
     }
+
     if (interrupted) {
         std::cerr << "Interrupted" << std::endl;
+    } else if (error == rapidjson::kParseErrorDocumentEmpty) {
+        // this is fine, we ran out of stuff to parse
+        retval = 0;
     } else {
-        auto error = document.GetParseError();
-        if (error == rapidjson::kParseErrorDocumentEmpty) {
-            // this is fine, we ran out of stuff to parse
-            retval = 0;
-        } else {
-            std::cerr << "Error parsing JSON: " << error << std::endl;
-            retval = error;
-        }
+        std::cerr << "Error parsing " << args::get(format) << ": " << error << std::endl;
+        retval = error;
     }
 
-    // flush output
-    output_stream->flush();
+    if (replay_clock) {
+        std::cerr << "Replay timing error: " << replay_clock->errors().format("us");
+    }
 
-    // close the outfile if it exists
-    if (output_stream && output_stream.get() != &std::cout) {
-        std::ofstream* file = dynamic_cast<std::ofstream*>(output_stream.get());
-        if (file) {
-            file->close();
-        }
+    output.close();
+    if (output_fd != STDOUT_FILENO) {
+        ::close(output_fd);
     }
 
     return retval;
@@ -0,0 +1,184 @@
+/****************************************************************************
+ *
+ * Copyright (c) 2024, libmav development team
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name libmav nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <sstream>
+#include <thread>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "args/args.hxx"
+#include "../common/OutputWriter.h"
+#include "../common/TrafficGenerator.h"
+#include "../common/builtinMessageSet.h"
+
+
+namespace {
+    std::function<void(int)> signalHandlerImpl;
+
+    // signal handler function
+    void signalHandler(int signal) {
+        std::cerr << "Received signal " << signal << std::endl;
+        if (signalHandlerImpl) {
+            signalHandlerImpl(signal);
+        } else {
+            exit(0);
+        }
+    }
+}
+
+
+int main(int argc, char *argv[]) {
+    std::signal(SIGINT, signalHandler);
+    args::ArgumentParser parser("mavgen", "Generates synthetic MAVLink traffic from a profile of message rates. "
+                                          "Profile entries look like NAME=Hz or NAME=Hz@sysid:compid, separated by commas or newlines.");
+    args::HelpFlag help(parser, "help", "Display this help menu", {'h', "help"});
+    args::ValueFlag<std::string> xml_file(parser, "message_set", "Mavlink message set XML to be used", {'x', "xml"});
+    args::ValueFlag<std::string> profile(parser, "profile", "Traffic profile, e.g. HEARTBEAT=1,ATTITUDE=50@1:1", {'p', "profile"});
+    args::ValueFlag<std::string> profile_file(parser, "file", "Read the traffic profile from a file", {"profile-file"});
+    args::ValueFlag<uint64_t> seed(parser, "seed", "Seed for the pseudo-random field values", {"seed"}, 1);
+    args::ValueFlag<double> duration(parser, "seconds", "Length of the generated traffic, in traffic time. Runs until interrupted if not set.", {'d', "duration"});
+    args::ValueFlag<uint64_t> count(parser, "messages", "Stop after this many messages", {'n', "count"});
+    args::Flag realtime(parser, "realtime", "Pace output to the profile rates instead of generating at maximum speed", {"realtime"});
+    args::ValueFlag<double> speed(parser, "factor", "Speed-up of the paced output, e.g. 10 for ten times the profile rates", {"speed"}, 1.0);
+    args::ValueFlag<std::string> output_file(parser, "output_file", "Output file for the generated messages. Writes to stdout when set to - or not set.", {'o', "output"});
+
+    try {
+        parser.ParseCLI(argc, argv);
+    } catch (args::Help) {
+        std::cout << parser;
+        return 0;
+    } catch (args::ParseError e) {
+        std::cerr << e.what() << std::endl;
+        std::cerr << parser;
+        return 1;
+    }
+
+    if (!profile == !profile_file) {
+        std::cerr << "Provide a profile with either --profile or --profile-file" << std::endl;
+        return 1;
+    }
+    if (args::get(speed) <= 0) {
+        std::cerr << "Speed must be positive" << std::endl;
+        return 1;
+    }
+
+    mav::MessageSet message_set;
+    if (xml_file) {
+        std::cerr << "Using XML file: " << args::get(xml_file) << std::endl;
+        message_set.addFromXML(args::get(xml_file));
+    } else {
+        std::cerr << "No XML file provided, loading built-in message set" << std::endl;
+        loadBuiltinMessageSet(message_set);
+    }
+
+    std::string profile_text;
+    if (profile_file) {
+        std::ifstream file(args::get(profile_file));
+        if (!file) {
+            std::cerr << "Could not open " << args::get(profile_file) << std::endl;
+            return 1;
+        }
+        std::stringstream ss;
+        ss << file.rdbuf();
+        profile_text = ss.str();
+    } else {
+        profile_text = args::get(profile);
+    }
+
+    std::vector<TrafficStream> streams;
+    try {
+        streams = parseTrafficProfile(profile_text, message_set);
+    } catch (std::invalid_argument &e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+
+    int output_fd = STDOUT_FILENO;
+    if (output_file && args::get(output_file) != "-") {
+        std::cerr << "Writing to file: " << args::get(output_file) << std::endl;
+        output_fd = ::open(args::get(output_file).c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (output_fd < 0) {
+            std::cerr << "Could not open " << args::get(output_file) << std::endl;
+            return 1;
+        }
+    } else {
+        std::cerr << "Writing to stdout" << std::endl;
+    }
+
+    std::atomic_bool interrupted{false};
+    int retval = 0;
+    signalHandlerImpl = [&](int signal) {
+        interrupted.store(true);
+        retval = signal;
+    };
+
+    // paced output should reach the consumer right away, at full speed it is written in large blocks
+    OutputWriter output{output_fd, realtime ? OutputWriter::FlushPolicy::MESSAGE : OutputWriter::FlushPolicy::FULL,
+                        std::chrono::milliseconds(50)};
+    TrafficGenerator generator{message_set, streams, args::get(seed)};
+
+    const double end_time = duration ? args::get(duration) : std::numeric_limits<double>::infinity();
+    const uint64_t max_messages = count ? args::get(count) : std::numeric_limits<uint64_t>::max();
+    const auto start = std::chrono::steady_clock::now();
+    std::string frame;
+    uint64_t messages = 0;
+    while (!interrupted.load() && messages < max_messages) {
+        frame.clear();
+        const double time = generator.next(frame);
+        if (time >= end_time) {
+            break;
+        }
+        if (realtime) {
+            std::this_thread::sleep_until(start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                    std::chrono::duration<double>(time / args::get(speed))));
+        }
+        output.write(frame);
+        messages++;
+    }
+
+    output.close();
+    if (output_fd != STDOUT_FILENO) {
+        ::close(output_fd);
+    }
+    std::cerr << "Generated " << messages << " messages" << std::endl;
+    return retval;
+}
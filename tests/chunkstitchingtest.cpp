@@ -0,0 +1,215 @@
+/****************************************************************************
+ *
+ * Copyright (c) 2024, libmav development team
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name libmav nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+/**
+ * Stitching of chunks processed in parallel: with chunks much smaller than the capture, the parallel decoder and the
+ * index builder have to produce exactly what a sequential pass does, also when frames straddle chunk boundaries and
+ * when a chunk synchronizes onto a false frame.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "../common/builtinMessageSet.h"
+#include "../common/MappedFile.h"
+#include "../common/StreamScanner.h"
+#include "../mavdecode/CaptureIndex.h"
+#include "../mavdecode/FileDecoder.h"
+
+
+namespace {
+    using Bytes = std::vector<uint8_t>;
+
+    constexpr size_t CHUNK_SIZE = 4096;
+    constexpr int THREADS = 4;
+
+    int failures = 0;
+
+    void check(bool condition, const std::string &description) {
+        if (!condition) {
+            std::cerr << "FAILED: " << description << std::endl;
+            failures++;
+        }
+    }
+
+    void appendHeader(Bytes &data, const FrameView &frame, size_t payload_length) {
+        data.insert(data.end(), {MAVLINK_MAGIC_V2, static_cast<uint8_t>(payload_length), 0, 0, frame.seq,
+                                 frame.system_id, frame.component_id, static_cast<uint8_t>(frame.message_id),
+                                 static_cast<uint8_t>(frame.message_id >> 8),
+                                 static_cast<uint8_t>(frame.message_id >> 16)});
+    }
+
+    void appendChecksum(FrameScanner &scanner, Bytes &data, size_t frame_start) {
+        const uint32_t message_id = data[frame_start + 7] | (data[frame_start + 8] << 8) | (data[frame_start + 9] << 16);
+        const uint16_t checksum = FrameScanner::crc(data.data() + frame_start + 1, data.size() - frame_start - 1,
+                                                    static_cast<uint8_t>(scanner.crcExtra(message_id)));
+        data.push_back(static_cast<uint8_t>(checksum));
+        data.push_back(static_cast<uint8_t>(checksum >> 8));
+    }
+
+    /**
+     * Pads data up to 12 bytes before boundary, and appends frame so that a chunk starting at boundary begins inside
+     * a valid outer frame, and synchronizes onto a valid false frame in its payload, which swallows frame.
+     */
+    void appendBehindFalseFrame(FrameScanner &scanner, std::mt19937 &random, Bytes &data, const FrameView &frame,
+                                size_t boundary) {
+        const size_t outer_start = boundary - 12;
+        data.resize(outer_start, 0);
+        appendHeader(data, frame, 16);
+        data.insert(data.end(), {static_cast<uint8_t>(random()), static_cast<uint8_t>(random())});
+        data.insert(data.end(), {static_cast<uint8_t>(random()), static_cast<uint8_t>(random())});
+        const size_t false_start = data.size();
+        // the rest of the outer payload, its checksum and frame
+        appendHeader(data, frame, 2 + 2 + frame.size);
+        data.insert(data.end(), {static_cast<uint8_t>(random()), static_cast<uint8_t>(random())});
+        appendChecksum(scanner, data, outer_start);
+        data.insert(data.end(), frame.data, frame.data + frame.size);
+        appendChecksum(scanner, data, false_start);
+    }
+
+    /**
+     * The frames of capture, between runs of noise with false magic bytes. Once per chunk, a frame sits behind a
+     * false frame that straddles the chunk boundary.
+     */
+    Bytes noisyCapture(const mav::MessageSet &message_set, const Bytes &capture) {
+        FrameScanner scanner{message_set};
+        std::mt19937 random{1};
+        Bytes noisy;
+        size_t false_frame_chunk = 0;
+        bool in_sync = false;
+        uint64_t discarded = 0;
+        StreamScanner::scanBlock(scanner, capture.data(), capture.size(), in_sync, discarded,
+                                 [&](const FrameView &frame) {
+            for (uint32_t i = random() % 24; i > 0; i--) {
+                noisy.push_back(i % 5 == 0 ? MAVLINK_MAGIC_V2 : i % 7 == 0 ? MAVLINK_MAGIC_V1
+                        : static_cast<uint8_t>(random()));
+            }
+            const size_t chunk = noisy.size() / CHUNK_SIZE + 1;
+            const size_t space = chunk * CHUNK_SIZE - noisy.size();
+            if (chunk > false_frame_chunk && space >= 12 && space < 256 &&
+                    frame.is_v2 && !frame.is_signed && frame.size <= 240) {
+                appendBehindFalseFrame(scanner, random, noisy, frame, chunk * CHUNK_SIZE);
+                false_frame_chunk = chunk;
+            } else {
+                noisy.insert(noisy.end(), frame.data, frame.data + frame.size);
+            }
+        }, [](const FrameView &) {});
+        return noisy;
+    }
+
+    std::string decodeSequentially(const DecodeOptions &options, const Bytes &capture) {
+        std::atomic_bool interrupted{false};
+        std::string output;
+        RangeDecoder{options}.decode(capture.data(), 0, capture.size(), capture.size(), interrupted,
+                                     [&output](size_t, size_t, std::string_view record) {
+            output.append(record);
+        });
+        return output;
+    }
+
+    std::string decodeInParallel(const DecodeOptions &options, const Bytes &capture) {
+        std::atomic_bool interrupted{false};
+        FILE *file = std::tmpfile();
+        {
+            OutputWriter output{fileno(file), OutputWriter::FlushPolicy::FULL, std::chrono::milliseconds(50)};
+            ParallelFileDecoder{options, THREADS, CHUNK_SIZE}.decode(capture.data(), capture.size(), output,
+                                                                     interrupted);
+        }
+        std::string text(static_cast<size_t>(std::ftell(file)), '\0');
+        std::rewind(file);
+        text.resize(std::fread(text.data(), 1, text.size(), file));
+        std::fclose(file);
+        return text;
+    }
+
+    void checkDecoding(const DecodeOptions &options, const Bytes &capture, const std::string &description) {
+        const std::string expected = decodeSequentially(options, capture);
+        check(!expected.empty(), description + ": there is output");
+        check(decodeInParallel(options, capture) == expected, description + ": parallel output matches");
+    }
+
+    /**
+     * An index with a block per frame, so the blocks list the offset of every frame.
+     */
+    CaptureIndex buildIndex(const mav::MessageSet &message_set, const Bytes &capture, int threads, size_t chunk_size) {
+        std::atomic_bool interrupted{false};
+        CaptureIndex index{1};
+        IndexBuilder{message_set, threads, chunk_size}.build(capture.data(), capture.size(), index, interrupted);
+        return index;
+    }
+
+    void checkIndex(const mav::MessageSet &message_set, const Bytes &capture, const std::string &description) {
+        const auto expected = buildIndex(message_set, capture, 1, capture.size());
+        const auto index = buildIndex(message_set, capture, THREADS, CHUNK_SIZE);
+        check(expected.frames() > 0, description + ": there are frames");
+        check(index.frames() == expected.frames(), description + ": the same number of frames is indexed");
+        bool same_blocks = index.blocks().size() == expected.blocks().size();
+        for (size_t i = 0; same_blocks && i < index.blocks().size(); i++) {
+            const auto &block = index.blocks()[i];
+            const auto &expected_block = expected.blocks()[i];
+            same_blocks = block.offset == expected_block.offset && block.start_time == expected_block.start_time &&
+                          block.min_time == expected_block.min_time && block.max_time == expected_block.max_time;
+        }
+        check(same_blocks, description + ": frame offsets and times match");
+    }
+}
+
+
+int main() {
+    mav::MessageSet message_set;
+    loadBuiltinMessageSet(message_set);
+
+    Bytes capture;
+    {
+        MappedFile file{EXAMPLE_CAPTURE};
+        capture.assign(file.data(), file.data() + file.size());
+    }
+    const Bytes noisy = noisyCapture(message_set, capture);
+
+    DecodeOptions options{message_set};
+    checkDecoding(options, capture, "example capture");
+    checkDecoding(options, noisy, "noisy capture");
+    checkIndex(message_set, capture, "example capture index");
+    checkIndex(message_set, noisy, "noisy capture index");
+
+    if (failures > 0) {
+        return EXIT_FAILURE;
+    }
+    std::cout << "chunkstitchingtest passed" << std::endl;
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,115 @@
+/****************************************************************************
+ *
+ * Copyright (c) 2024, libmav development team
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name libmav nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+/**
+ * Sequence gap accounting of LinkStatistics: filtering messages must not show up as lost messages.
+ */
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+#include "../common/builtinMessageSet.h"
+#include "../common/FrameFilter.h"
+#include "../common/MappedFile.h"
+#include "../common/StreamScanner.h"
+#include "../mavdecode/LinkStatistics.h"
+
+
+namespace {
+    /**
+     * @return the sources part of a statistics report over the example capture, with the given include selector
+     */
+    std::string sourcesReport(const mav::MessageSet &message_set, const std::string &include) {
+        FrameFilter filter;
+        if (!include.empty()) {
+            filter.include(include, message_set);
+        }
+        FrameScanner scanner{message_set};
+        LinkStatistics statistics{message_set};
+        MappedFile capture{EXAMPLE_CAPTURE};
+        bool in_sync = false;
+        uint64_t discarded = 0;
+        StreamScanner::scanBlock(scanner, capture.data(), capture.size(), in_sync, discarded,
+                                 [&](const FrameView &frame) { statistics.onFrame(frame, filter.accepts(frame)); },
+                                 [&](const FrameView &frame) {
+            if (filter.accepts(frame)) {
+                statistics.onCrcError(frame);
+            }
+        });
+        const std::string report{statistics.report(std::chrono::seconds(5), discarded)};
+        const size_t sources = report.find("\"sources\"");
+        return sources == std::string::npos ? std::string{} : report.substr(sources);
+    }
+
+    /**
+     * @return the number after the first occurrence of "key": in a report, or -1 if it is missing
+     */
+    long long reportedNumber(const std::string &report, const std::string &key) {
+        const std::string pattern = "\"" + key + "\": ";
+        const size_t position = report.find(pattern);
+        return position == std::string::npos ? -1 : std::atoll(report.c_str() + position + pattern.size());
+    }
+
+    int failures = 0;
+
+    void check(bool condition, const std::string &description) {
+        if (!condition) {
+            std::cerr << "FAILED: " << description << std::endl;
+            failures++;
+        }
+    }
+}
+
+
+int main() {
+    mav::MessageSet message_set;
+    loadBuiltinMessageSet(message_set);
+
+    const std::string unfiltered = sourcesReport(message_set, "");
+    const std::string filtered = sourcesReport(message_set, "ATTITUDE");
+    check(reportedNumber(unfiltered, "messages") > 0, "the capture has messages");
+    check(reportedNumber(filtered, "messages") == reportedNumber(unfiltered, "messages"),
+          "every frame counts for its source, also the filtered out ones");
+    check(reportedNumber(filtered, "lost") == reportedNumber(unfiltered, "lost"),
+          "filtering does not add lost messages");
+    check(reportedNumber(filtered, "sequence_gaps") == reportedNumber(unfiltered, "sequence_gaps"),
+          "filtering does not add sequence gaps");
+
+    if (failures > 0) {
+        return EXIT_FAILURE;
+    }
+    std::cout << "linkstatisticstest passed" << std::endl;
+    return EXIT_SUCCESS;
+}
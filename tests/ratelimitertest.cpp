@@ -0,0 +1,179 @@
+/****************************************************************************
+ *
+ * Copyright (c) 2024, libmav development team
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name libmav nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+/**
+ * Decimation of RateLimiter over synthetic receive times: the latest message of a period wins, the cadence restarts
+ * after a silent stream, and the final release passes whatever is still held back.
+ */
+
+#include <cstdlib>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include "../common/builtinMessageSet.h"
+#include "../mavdecode/RateLimiter.h"
+
+
+namespace {
+    using Bytes = std::vector<uint8_t>;
+
+    constexpr uint32_t HEARTBEAT = 0;
+    constexpr uint32_t ATTITUDE = 30;
+    // ATTITUDE is limited to 10 Hz
+    constexpr uint64_t PERIOD_US = 100000;
+
+    struct Emitted {
+        uint8_t system_id;
+        uint8_t seq;
+        uint64_t time_us;
+        Bytes data;
+
+        bool operator==(const Emitted &other) const {
+            return system_id == other.system_id && seq == other.seq && time_us == other.time_us && data == other.data;
+        }
+    };
+
+    int failures = 0;
+
+    void check(bool condition, const std::string &description) {
+        if (!condition) {
+            std::cerr << "FAILED: " << description << std::endl;
+            failures++;
+        }
+    }
+
+    /**
+     * A MAVLink 2 frame, only the header matters to the rate limiter.
+     */
+    Bytes frame(uint32_t message_id, uint8_t system_id, uint8_t seq) {
+        return {MAVLINK_MAGIC_V2, 1, 0, 0, seq, system_id, 1, static_cast<uint8_t>(message_id),
+                static_cast<uint8_t>(message_id >> 8), static_cast<uint8_t>(message_id >> 16), seq, 0, 0};
+    }
+
+    class Run {
+    private:
+        RateLimiter _limiter;
+
+        void _emit(const FrameView &view, uint64_t time_us) {
+            emitted.push_back({view.system_id, view.seq, time_us, Bytes(view.data, view.data + view.size)});
+        }
+
+    public:
+        std::vector<Emitted> emitted;
+
+        Run(const mav::MessageSet &message_set, const RateLimits &limits) : _limiter(message_set, limits) {}
+
+        /**
+         * @return what the offered frame is expected to look like when it is emitted
+         */
+        Emitted offer(uint32_t message_id, uint8_t system_id, uint8_t seq, uint64_t time_us) {
+            const Bytes data = frame(message_id, system_id, seq);
+            FrameView view;
+            FrameScanner::parseHeader(data.data(), data.size(), view);
+            _limiter.offer(view, time_us, [this](const FrameView &emitted, uint64_t emitted_time_us) {
+                _emit(emitted, emitted_time_us);
+            });
+            return {system_id, seq, time_us, data};
+        }
+
+        void release(uint64_t time_us) {
+            _limiter.release(time_us, [this](const FrameView &emitted, uint64_t emitted_time_us) {
+                _emit(emitted, emitted_time_us);
+            });
+        }
+
+        [[nodiscard]] std::string report() const {
+            return _limiter.report();
+        }
+    };
+}
+
+
+int main() {
+    mav::MessageSet message_set;
+    loadBuiltinMessageSet(message_set);
+    RateLimits limits{message_set};
+    limits.add("ATTITUDE=10");
+
+    Run run{message_set, limits};
+    std::vector<Emitted> expected;
+
+    // unlimited messages pass right away
+    for (uint8_t seq = 0; seq < 3; seq++) {
+        expected.push_back(run.offer(HEARTBEAT, 1, seq, seq * 1000));
+    }
+    check(run.emitted == expected, "unlimited messages pass");
+
+    // the first message passes, then the latest of a period is held back until it ends
+    expected.push_back(run.offer(ATTITUDE, 1, 0, 0));
+    run.offer(ATTITUDE, 1, 1, 20000);
+    const auto latest = run.offer(ATTITUDE, 1, 2, 50000);
+    check(run.emitted == expected, "messages within a period are held back");
+    run.release(PERIOD_US - 1);
+    check(run.emitted == expected, "nothing is released before the period ends");
+    run.release(PERIOD_US);
+    expected.push_back(latest);
+    check(run.emitted == expected, "the latest message of the period is released, with its own time");
+
+    // a message arriving after the period passes right away, replacing the one held back
+    run.offer(ATTITUDE, 1, 3, 120000);
+    expected.push_back(run.offer(ATTITUDE, 1, 4, 2 * PERIOD_US + 10000));
+    check(run.emitted == expected, "a message after the period passes and replaces the held back one");
+
+    // after a silent stream, the period starts with the next message instead of catching up
+    expected.push_back(run.offer(ATTITUDE, 1, 5, 10 * PERIOD_US));
+    run.offer(ATTITUDE, 1, 6, 10 * PERIOD_US + 50000);
+    const auto last = run.offer(ATTITUDE, 1, 7, 10 * PERIOD_US + 80000);
+    check(run.emitted == expected, "the period restarts after silence");
+
+    // every source has its own period
+    expected.push_back(run.offer(ATTITUDE, 2, 100, 10 * PERIOD_US + 50000));
+    check(run.emitted == expected, "sources are limited separately");
+
+    run.release(std::numeric_limits<uint64_t>::max());
+    expected.push_back(last);
+    check(run.emitted == expected, "the final release passes the held back message");
+    run.release(std::numeric_limits<uint64_t>::max());
+    check(run.emitted == expected, "a message is only released once");
+
+    check(run.report() == "Rate limited ATTITUDE to 10 Hz: dropped 3 of 8\n", "dropped messages are counted");
+
+    if (failures > 0) {
+        return EXIT_FAILURE;
+    }
+    std::cout << "ratelimitertest passed" << std::endl;
+    return EXIT_SUCCESS;
+}
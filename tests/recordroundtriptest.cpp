@@ -0,0 +1,161 @@
+/****************************************************************************
+ *
+ * Copyright (c) 2024, libmav development team
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name libmav nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+/**
+ * Round trips of decoded records through mavencode: what mavdecode writes, mavencode has to turn back into the
+ * messages of the capture.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "../common/builtinMessageSet.h"
+#include "../common/MappedFile.h"
+#include "../common/StreamScanner.h"
+#include "../mavdecode/DecodeOptions.h"
+#include "../mavencode/BinaryRecordParser.h"
+
+
+namespace {
+    using Bytes = std::vector<uint8_t>;
+
+    int failures = 0;
+
+    void check(bool condition, const std::string &description) {
+        if (!condition) {
+            std::cerr << "FAILED: " << description << std::endl;
+            failures++;
+        }
+    }
+
+    /**
+     * The records of every frame of capture that has output, in the given format.
+     */
+    std::string decode(const mav::MessageSet &message_set, const Bytes &capture, OutputFormat format) {
+        DecodeOptions options{message_set};
+        options.format = format;
+        RecordFormatter formatter{options};
+        FrameScanner scanner{message_set};
+        std::string records;
+        bool in_sync = false;
+        uint64_t discarded = 0;
+        StreamScanner::scanBlock(scanner, capture.data(), capture.size(), in_sync, discarded,
+                                 [&](const FrameView &frame) {
+            records.append(formatter.formatFrame(frame));
+        }, [](const FrameView &) {});
+        return records;
+    }
+
+    /**
+     * Header values and payload of every frame of capture, without trailing zeros and without payload bytes that
+     * no field of the message set covers, as those can not survive a round trip.
+     */
+    std::vector<std::string> messages(const mav::MessageSet &message_set, const Bytes &capture) {
+        FrameScanner scanner{message_set};
+        std::vector<std::string> messages;
+        bool in_sync = false;
+        uint64_t discarded = 0;
+        StreamScanner::scanBlock(scanner, capture.data(), capture.size(), in_sync, discarded,
+                                 [&](const FrameView &frame) {
+            const auto definition = message_set.getMessageDefinition(static_cast<int>(frame.message_id));
+            size_t length = std::min<size_t>(frame.payload_length, definition.get().maxPayloadSize());
+            while (length > 0 && frame.payload()[length - 1] == 0) {
+                length--;
+            }
+            messages.push_back(std::to_string(frame.message_id) + " " + std::to_string(frame.system_id) + " " +
+                               std::to_string(frame.component_id) + " " + std::to_string(frame.seq) + " " +
+                               std::string(reinterpret_cast<const char *>(frame.payload()), length));
+        }, [](const FrameView &) {});
+        return messages;
+    }
+
+    /**
+     * Binary records keep the bits of every float, so the encoded frames have to carry the original messages.
+     */
+    void checkBinaryRoundTrip(const mav::MessageSet &message_set, const Bytes &capture, OutputFormat output_format,
+                              InputFormat input_format, const std::string &description) {
+        const std::string records = decode(message_set, capture, output_format);
+        Bytes encoded;
+        MessageBuilder builder{message_set, [&encoded](const uint8_t *data, size_t size, uint64_t) {
+            encoded.insert(encoded.end(), data, data + size);
+        }};
+        std::atomic_bool interrupted{false};
+        const auto *begin = reinterpret_cast<const uint8_t *>(records.data());
+        const auto result = parseBinaryRecords(input_format, begin, begin + records.size(), builder, interrupted);
+        check(!records.empty(), description + ": there are records");
+        check(result == rapidjson::kParseErrorDocumentEmpty, description + ": all records are parsed");
+        check(messages(message_set, encoded) == messages(message_set, capture),
+              description + ": the encoded frames carry the original messages");
+    }
+}
+
+
+int main() {
+    mav::MessageSet message_set;
+    loadBuiltinMessageSet(message_set);
+
+    Bytes capture;
+    {
+        MappedFile file{EXAMPLE_CAPTURE};
+        capture.assign(file.data(), file.data() + file.size());
+    }
+    std::atomic_bool interrupted{false};
+
+    // JSON spells every NaN the same, so the encoded frames are compared by their records
+    {
+        const std::string records = decode(message_set, capture, OutputFormat::JSON);
+        Bytes encoded;
+        MessageBuilder builder{message_set, [&encoded](const uint8_t *data, size_t size, uint64_t) {
+            encoded.insert(encoded.end(), data, data + size);
+        }};
+        std::string input = records;
+        const auto result = parseRecords(input.data(), input.data() + input.size(), builder, interrupted);
+        check(!records.empty(), "json: there are records");
+        check(result == rapidjson::kParseErrorDocumentEmpty, "json: all records are parsed");
+        check(decode(message_set, encoded, OutputFormat::JSON) == records, "json: the encoded frames decode the same");
+    }
+
+    checkBinaryRoundTrip(message_set, capture, OutputFormat::CBOR, InputFormat::CBOR, "cbor");
+    checkBinaryRoundTrip(message_set, capture, OutputFormat::MSGPACK, InputFormat::MSGPACK, "msgpack");
+
+    if (failures > 0) {
+        return EXIT_FAILURE;
+    }
+    std::cout << "recordroundtriptest passed" << std::endl;
+    return EXIT_SUCCESS;
+}
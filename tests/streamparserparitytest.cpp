@@ -0,0 +1,194 @@
+/****************************************************************************
+ *
+ * Copyright (c) 2024, libmav development team
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name libmav nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+/**
+ * Parity of the stream inputs with the StreamParser that mavdecode used for stdin before: both have to find the
+ * same messages in a capture, and the stream inputs at least the same ones in a noisy capture.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "mav/Network.h"
+#include "../common/builtinMessageSet.h"
+#include "../common/MappedFile.h"
+#include "../common/MessagePlan.h"
+#include "../mavdecode/LiveInput.h"
+
+
+namespace {
+    using Bytes = std::vector<uint8_t>;
+
+    /**
+     * Serves a byte buffer to a StreamParser, and interrupts it once the buffer can not fill a read any more.
+     */
+    class MemoryInterface : public mav::NetworkInterface {
+    private:
+        const Bytes &_data;
+        size_t _position = 0;
+
+    public:
+        explicit MemoryInterface(const Bytes &data) : _data(data) {}
+
+        void close() override {}
+
+        void send(const uint8_t *, uint32_t, mav::ConnectionPartner) override {}
+
+        mav::ConnectionPartner receive(uint8_t *destination, uint32_t size) override {
+            if (_data.size() - _position < size) {
+                throw mav::NetworkInterfaceInterrupt();
+            }
+            std::copy(_data.begin() + _position, _data.begin() + _position + size, destination);
+            _position += size;
+            return mav::ConnectionPartner{};
+        }
+    };
+
+    /**
+     * What identifies a message: its header values and its payload, without trailing zeros.
+     */
+    std::string describe(const RawMessage &message) {
+        std::string description = std::to_string(message.message_id) + " " + std::to_string(message.system_id) +
+                                  " " + std::to_string(message.component_id) + " " + std::to_string(message.seq);
+        size_t length = message.payload_length;
+        while (length > 0 && message.payload[length - 1] == 0) {
+            length--;
+        }
+        description.append(" ").append(reinterpret_cast<const char *>(message.payload), length);
+        return description;
+    }
+
+    std::vector<std::string> parseWithStreamParser(const mav::MessageSet &message_set, const Bytes &data) {
+        MemoryInterface interface{data};
+        mav::StreamParser stream_parser{message_set, interface};
+        std::vector<std::string> messages;
+        try {
+            while (true) {
+                messages.push_back(describe(RawMessage::fromMessage(stream_parser.next())));
+            }
+        } catch (mav::NetworkInterfaceInterrupt &) {
+        }
+        return messages;
+    }
+
+    std::vector<std::string> parseWithDescriptorInput(const mav::MessageSet &message_set, const Bytes &data) {
+        FILE *file = std::tmpfile();
+        std::fwrite(data.data(), 1, data.size(), file);
+        std::fflush(file);
+        std::rewind(file);
+        DescriptorInput input{message_set, fileno(file)};
+        std::vector<std::string> messages;
+        while (input.poll(std::chrono::milliseconds(100), [&messages](const FrameView &frame) {
+            // the StreamParser only reads MAVLink 2
+            if (frame.is_v2) {
+                messages.push_back(describe(RawMessage::fromFrame(frame)));
+            }
+        }, [](const FrameView &) {})) {}
+        std::fclose(file);
+        return messages;
+    }
+
+    /**
+     * @return true if every message of expected is in found, in the same order
+     */
+    bool containsInOrder(const std::vector<std::string> &found, const std::vector<std::string> &expected) {
+        size_t position = 0;
+        for (const auto &message : expected) {
+            while (position < found.size() && found[position] != message) {
+                position++;
+            }
+            if (position == found.size()) {
+                return false;
+            }
+            position++;
+        }
+        return true;
+    }
+
+    int failures = 0;
+
+    void check(bool condition, const std::string &description) {
+        if (!condition) {
+            std::cerr << "FAILED: " << description << std::endl;
+            failures++;
+        }
+    }
+}
+
+
+int main() {
+    mav::MessageSet message_set;
+    loadBuiltinMessageSet(message_set);
+
+    Bytes capture;
+    {
+        MappedFile file{EXAMPLE_CAPTURE};
+        capture.assign(file.data(), file.data() + file.size());
+    }
+    // runs of random bytes with magic bytes between the frames of the capture
+    Bytes noisy;
+    {
+        std::mt19937 random{1};
+        FrameScanner scanner{message_set};
+        bool in_sync = false;
+        uint64_t discarded = 0;
+        StreamScanner::scanBlock(scanner, capture.data(), capture.size(), in_sync, discarded,
+                                 [&](const FrameView &frame) {
+            for (uint32_t i = random() % 32; i > 0; i--) {
+                noisy.push_back(i % 7 == 0 ? MAVLINK_MAGIC_V2 : static_cast<uint8_t>(random()));
+            }
+            noisy.insert(noisy.end(), frame.data, frame.data + frame.size);
+        }, [](const FrameView &) {});
+    }
+
+    const auto expected = parseWithStreamParser(message_set, capture);
+    const auto found = parseWithDescriptorInput(message_set, capture);
+    check(!expected.empty(), "the StreamParser finds messages in the capture");
+    check(found == expected, "the same messages as the StreamParser in the capture");
+
+    const auto expected_noisy = parseWithStreamParser(message_set, noisy);
+    const auto found_noisy = parseWithDescriptorInput(message_set, noisy);
+    check(containsInOrder(found_noisy, expected_noisy), "at least the messages of the StreamParser in noise");
+    check(found_noisy == found, "the same messages in noise as without");
+
+    if (failures > 0) {
+        return EXIT_FAILURE;
+    }
+    std::cout << "streamparserparitytest passed" << std::endl;
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,179 @@
+/****************************************************************************
+ *
+ * Copyright (c) 2024, libmav development team
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name libmav nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+/**
+ * Framing of datagrams and of the end of streams: a false magic byte or a truncated frame must not hide the frames
+ * after it, when no more data can complete it.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "../common/builtinMessageSet.h"
+#include "../common/MappedFile.h"
+#include "../common/StreamScanner.h"
+#include "../common/Tlog.h"
+#include "../mavdecode/LiveInput.h"
+
+
+namespace {
+    using Bytes = std::vector<uint8_t>;
+
+    int failures = 0;
+
+    void check(bool condition, const std::string &description) {
+        if (!condition) {
+            std::cerr << "FAILED: " << description << std::endl;
+            failures++;
+        }
+    }
+
+    /**
+     * Scans a datagram of prefix and frame, and checks that exactly the frame is found, after discarding the prefix.
+     */
+    void checkDatagram(FrameScanner &scanner, const Bytes &prefix, const Bytes &frame, const std::string &description) {
+        Bytes datagram = prefix;
+        datagram.insert(datagram.end(), frame.begin(), frame.end());
+        std::vector<Bytes> frames;
+        uint64_t discarded = 0;
+        StreamScanner::scanDatagram(scanner, datagram.data(), datagram.size(), discarded,
+                                    [&frames](const FrameView &view) {
+            frames.emplace_back(view.data, view.data + view.size);
+        }, [](const FrameView &) {});
+        check(frames.size() == 1 && frames[0] == frame, description + ": the valid frame is found");
+        check(discarded == prefix.size(), description + ": only the bytes before it are discarded");
+    }
+
+    /**
+     * Reads the bytes through an input from a temporary file, and checks that it finds expected_count frames, the
+     * last one being last_frame.
+     */
+    template<typename Input>
+    void checkStream(const mav::MessageSet &message_set, const Bytes &bytes, size_t expected_count,
+                     const Bytes &last_frame, const std::string &description) {
+        FILE *file = std::tmpfile();
+        std::fwrite(bytes.data(), 1, bytes.size(), file);
+        std::fflush(file);
+        std::rewind(file);
+        Input input{message_set, fileno(file)};
+        size_t count = 0;
+        Bytes last;
+        while (input.poll(std::chrono::milliseconds(100), [&](const FrameView &frame) {
+            count++;
+            last.assign(frame.data, frame.data + frame.size);
+        }, [](const FrameView &) {})) {}
+        std::fclose(file);
+        check(count == expected_count, description + ": every frame is found");
+        check(last == last_frame, description + ": the last frame is found");
+    }
+}
+
+
+int main() {
+    mav::MessageSet message_set;
+    loadBuiltinMessageSet(message_set);
+    FrameScanner scanner{message_set};
+
+    // the longest and the shortest v2 frame of the example capture, and the capture as a stream and as a tlog
+    Bytes longest;
+    Bytes shortest;
+    Bytes stream;
+    Bytes tlog;
+    size_t frame_count = 0;
+    {
+        MappedFile capture{EXAMPLE_CAPTURE};
+        bool in_sync = false;
+        uint64_t discarded = 0;
+        StreamScanner::scanBlock(scanner, capture.data(), capture.size(), in_sync, discarded,
+                                 [&](const FrameView &frame) {
+            frame_count++;
+            stream.insert(stream.end(), frame.data, frame.data + frame.size);
+            auto timestamp = encodeTlogTimestamp(frame_count * 1000);
+            tlog.insert(tlog.end(), timestamp.begin(), timestamp.end());
+            tlog.insert(tlog.end(), frame.data, frame.data + frame.size);
+            if (!frame.is_v2) {
+                return;
+            }
+            if (frame.size > longest.size()) {
+                longest.assign(frame.data, frame.data + frame.size);
+            }
+            if (shortest.empty() || frame.size < shortest.size()) {
+                shortest.assign(frame.data, frame.data + frame.size);
+            }
+        }, [](const FrameView &) {});
+    }
+    check(!shortest.empty(), "the capture has v2 frames");
+    if (shortest.empty()) {
+        return EXIT_FAILURE;
+    }
+
+    // a header claiming a longer payload than the rest of the datagram
+    Bytes false_header{shortest.begin(), shortest.begin() + MAVLINK_HEADER_SIZE_V2};
+    false_header[1] = 255;
+    checkDatagram(scanner, false_header, shortest, "false magic byte");
+
+    // a frame cut off after its header, followed by a frame shorter than its missing payload
+    check(longest.size() > MAVLINK_HEADER_SIZE_V2 + 1 + shortest.size(), "the longest frame is long enough");
+    Bytes truncated{longest.begin(), longest.begin() + MAVLINK_HEADER_SIZE_V2 + 1};
+    checkDatagram(scanner, truncated, shortest, "truncated frame");
+
+    // a frame with a corrupted payload is complete, and still found to be invalid
+    Bytes corrupted = longest;
+    corrupted[MAVLINK_HEADER_SIZE_V2] ^= 0x55;
+    checkDatagram(scanner, corrupted, shortest, "corrupted frame");
+
+    // a false magic byte right before the last frame of a stream, which the end of the stream can not complete
+    Bytes stream_end = stream;
+    stream_end.insert(stream_end.end(), false_header.begin(), false_header.end());
+    stream_end.insert(stream_end.end(), shortest.begin(), shortest.end());
+    checkStream<DescriptorInput>(message_set, stream_end, frame_count + 1, shortest, "end of stream");
+
+    // the same in a tlog, where the false header is a record of its own
+    auto timestamp = encodeTlogTimestamp(frame_count * 1000);
+    Bytes tlog_end = tlog;
+    tlog_end.insert(tlog_end.end(), timestamp.begin(), timestamp.end());
+    tlog_end.insert(tlog_end.end(), false_header.begin(), false_header.end());
+    tlog_end.insert(tlog_end.end(), timestamp.begin(), timestamp.end());
+    tlog_end.insert(tlog_end.end(), shortest.begin(), shortest.end());
+    checkStream<TlogInput>(message_set, tlog_end, frame_count + 1, shortest, "end of tlog");
+
+    if (failures > 0) {
+        return EXIT_FAILURE;
+    }
+    std::cout << "streamscannertest passed" << std::endl;
+    return EXIT_SUCCESS;
+}